@@ -0,0 +1,367 @@
+/* buffer_cache.c: Cache of file system disk sectors.
+ *
+ * All sectors of file system data and metadata are read and written
+ * through a fixed table of BUFFER_CACHE_SIZE sector buffers, so that
+ * accesses to the same sector in short order, such as the byte-sized
+ * reads and writes of a program walking through a file, cost one disk
+ * access instead of one each.
+ *
+ * Replacement follows the clock algorithm over the table.  Writes only
+ * mark a buffer dirty: it is written back when it is evicted, by the
+ * flush daemon every BUFFER_CACHE_FLUSH_TICKS, and by filesys_done().
+ * Sequential readers of a file ask for the sectors they are about to read
+ * (see file_read()), which the read-ahead daemon then loads in the
+ * background.
+ *
+ * Metadata are written through the journal (see journal.c), which asks
+ * for them with buffer_cache_write_tx().  Such a buffer belongs to the
+ * running transaction until the journal commits it, and is neither
+ * evicted nor written back meanwhile, since the disk must not see it
+ * before the journal does.  If it held a committed change not yet written
+ * back when the transaction took it over, that change is set aside in a
+ * shadow copy, for the journal to write back when it needs its space.
+ *
+ * The table is protected by CACHE_LOCK, which is not held during disk
+ * I/O.  A buffer under I/O is marked as such, and anybody who wants it
+ * waits on IO_DONE meanwhile. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors cached. */
+#define BUFFER_CACHE_SIZE 64
+
+/* Interval between two write-backs of the dirty buffers. */
+#define BUFFER_CACHE_FLUSH_TICKS (5 * TIMER_FREQ)
+
+/* Number of read-ahead requests that may wait for the daemon: enough for
+ * a couple of files read sequentially with the largest window (see
+ * file.c). */
+#define READ_AHEAD_QUEUE 32
+
+/* A sector buffer. */
+struct cache_entry {
+	disk_sector_t sector;           /* Sector held, if VALID. */
+	bool valid;                     /* Holds a sector at all? */
+	bool dirty;                     /* Newer than the sector on disk? */
+	bool accessed;                  /* Used since the clock hand passed? */
+	bool io;                        /* Being read or written right now? */
+	bool tx;                        /* In the running transaction? */
+	uint8_t *shadow;                /* Committed contents not on disk yet,
+	                                   if TX. */
+	uint8_t data[DISK_SECTOR_SIZE];
+};
+
+static struct cache_entry cache[BUFFER_CACHE_SIZE];
+static size_t clock_hand;
+static struct lock cache_lock;
+static struct condition io_done;
+
+/* Sectors waiting to be read ahead, a ring buffer.  Protected by
+ * CACHE_LOCK. */
+static disk_sector_t ra_queue[READ_AHEAD_QUEUE];
+static size_t ra_head;
+static size_t ra_queued;
+static struct condition ra_ready;
+static bool ra_waiting;               /* Read-ahead daemon waits on RA_READY. */
+
+/* Statistics. */
+static long long hit_cnt;             /* Sectors found in the cache. */
+static long long miss_cnt;            /* Sectors read on demand. */
+static long long read_ahead_cnt;      /* Sectors read ahead. */
+
+static void buffer_cache_flushd (void *aux);
+static void buffer_cache_read_aheadd (void *aux);
+
+/* Initializes the cache and starts its daemons. */
+void
+buffer_cache_init (void) {
+	lock_init (&cache_lock);
+	cond_init (&io_done);
+	cond_init (&ra_ready);
+	thread_create ("flushd", PRI_DEFAULT, buffer_cache_flushd, NULL);
+	thread_create ("readaheadd", PRI_DEFAULT, buffer_cache_read_aheadd, NULL);
+}
+
+/* Returns the buffer that holds SECTOR, or NULL.  CACHE_LOCK must be
+ * held. */
+static struct cache_entry *
+cache_find (disk_sector_t sector) {
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++)
+		if (cache[i].valid && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Reads E's sector into it, or writes it out if WRITE is true, with
+ * CACHE_LOCK released meanwhile. */
+static void
+cache_io (struct cache_entry *e, bool write) {
+	ASSERT (!e->io);
+
+	e->io = true;
+	lock_release (&cache_lock);
+	if (write)
+		disk_write (filesys_disk, e->sector, e->data);
+	else
+		disk_read (filesys_disk, e->sector, e->data);
+	lock_acquire (&cache_lock);
+	e->io = false;
+	cond_broadcast (&io_done, &cache_lock);
+}
+
+/* Writes dirty buffer E back to disk. */
+static void
+cache_write_back (struct cache_entry *e) {
+	e->dirty = false;
+	cache_io (e, true);
+}
+
+/* Picks a buffer to reuse with the clock algorithm.  Returns NULL if
+ * CACHE_LOCK had to be dropped first, to write back a dirty buffer or to
+ * wait for I/O, in which case the caller must look for its sector again. */
+static struct cache_entry *
+cache_victim (void) {
+	for (size_t i = 0; i < 2 * BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % BUFFER_CACHE_SIZE;
+
+		if (e->io || e->tx)
+			continue;
+		if (e->accessed) {
+			e->accessed = false;
+			continue;
+		}
+		if (e->valid && e->dirty) {
+			cache_write_back (e);
+			return NULL;
+		}
+		return e;
+	}
+
+	/* Every buffer is under I/O or in the running transaction. */
+	cond_wait (&io_done, &cache_lock);
+	return NULL;
+}
+
+/* Returns the buffer for SECTOR, loading it from disk unless READ is
+ * false, in which case the caller is about to overwrite all of it.  Sets
+ * *HIT to whether SECTOR was cached already.  CACHE_LOCK must be held;
+ * it is dropped and taken again if I/O is needed. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool read, bool *hit) {
+	struct cache_entry *e;
+
+	for (;;) {
+		e = cache_find (sector);
+		if (e != NULL) {
+			if (!e->io) {
+				e->accessed = true;
+				*hit = true;
+				return e;
+			}
+			cond_wait (&io_done, &cache_lock);
+		} else if ((e = cache_victim ()) != NULL)
+			break;
+	}
+
+	*hit = false;
+	e->sector = sector;
+	e->valid = true;
+	e->dirty = false;
+	e->accessed = true;
+	if (read)
+		cache_io (e, false);
+	return e;
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, size_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+	bool hit;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = cache_get (sector, true, &hit);
+	if (hit)
+		hit_cnt++;
+	else
+		miss_cnt++;
+	memcpy (buffer, e->data + ofs, size);
+	lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+	bool hit;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = cache_get (sector, size < DISK_SECTOR_SIZE, &hit);
+	if (hit)
+		hit_cnt++;
+	else
+		miss_cnt++;
+	memcpy (e->data + ofs, buffer, size);
+	e->dirty = true;
+	lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR, as part of
+ * the running transaction of the journal. */
+void
+buffer_cache_write_tx (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+	bool hit;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = cache_get (sector, size < DISK_SECTOR_SIZE, &hit);
+	if (hit)
+		hit_cnt++;
+	else
+		miss_cnt++;
+	if (!e->tx && e->dirty) {
+		/* Keep the committed contents for the checkpoint, or write them
+		 * back right away if there is no memory for that. */
+		e->shadow = malloc (DISK_SECTOR_SIZE);
+		if (e->shadow != NULL)
+			memcpy (e->shadow, e->data, DISK_SECTOR_SIZE);
+		else
+			cache_write_back (e);
+	}
+	e->tx = true;
+	memcpy (e->data + ofs, buffer, size);
+	e->dirty = true;
+	lock_release (&cache_lock);
+}
+
+/* Hands SECTOR, in the transaction the journal just committed, back to
+ * the cache, to be written back in its own time. */
+void
+buffer_cache_commit (disk_sector_t sector) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	e = cache_find (sector);
+	ASSERT (e != NULL && e->tx);
+	e->tx = false;
+	free (e->shadow);
+	e->shadow = NULL;
+	lock_release (&cache_lock);
+}
+
+/* Writes the last committed contents of SECTOR back to disk, if they are
+ * only in the cache. */
+void
+buffer_cache_checkpoint (disk_sector_t sector) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	while ((e = cache_find (sector)) != NULL && e->io)
+		cond_wait (&io_done, &cache_lock);
+	if (e != NULL && e->shadow != NULL) {
+		uint8_t *shadow = e->shadow;
+
+		e->io = true;
+		lock_release (&cache_lock);
+		disk_write (filesys_disk, sector, shadow);
+		lock_acquire (&cache_lock);
+		e->io = false;
+		e->shadow = NULL;
+		free (shadow);
+		cond_broadcast (&io_done, &cache_lock);
+	} else if (e != NULL && e->dirty && !e->tx)
+		cache_write_back (e);
+	lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.  The
+ * request is dropped if the queue is full. */
+void
+buffer_cache_read_ahead (disk_sector_t sector) {
+	lock_acquire (&cache_lock);
+	if (ra_queued < READ_AHEAD_QUEUE && cache_find (sector) == NULL) {
+		ra_queue[(ra_head + ra_queued++) % READ_AHEAD_QUEUE] = sector;
+		/* cond_signal() needs a waiter to wake. */
+		if (ra_waiting) {
+			ra_waiting = false;
+			cond_signal (&ra_ready, &cache_lock);
+		}
+	}
+	lock_release (&cache_lock);
+}
+
+/* Writes all dirty buffers back to disk, but those of the running
+ * transaction, and waits for write-backs that others have started. */
+void
+buffer_cache_flush (void) {
+	lock_acquire (&cache_lock);
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+		while (e->io)
+			cond_wait (&io_done, &cache_lock);
+		if (e->valid && e->dirty && !e->tx)
+			cache_write_back (e);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Prints cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	long long total = hit_cnt + miss_cnt;
+	printf ("Buffer cache: %lld hits, %lld misses (%lld%% hit rate), "
+			"%lld sectors read ahead\n", hit_cnt, miss_cnt,
+			total > 0 ? hit_cnt * 100 / total : 0, read_ahead_cnt);
+}
+
+/* Commits the running transaction and writes the dirty buffers back
+ * every BUFFER_CACHE_FLUSH_TICKS, forever. */
+static void
+buffer_cache_flushd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (BUFFER_CACHE_FLUSH_TICKS);
+		journal_commit ();
+		buffer_cache_flush ();
+	}
+}
+
+/* Serves read-ahead requests, forever. */
+static void
+buffer_cache_read_aheadd (void *aux UNUSED) {
+	lock_acquire (&cache_lock);
+	for (;;) {
+		disk_sector_t sector;
+		bool hit;
+
+		while (ra_queued == 0) {
+			ra_waiting = true;
+			cond_wait (&ra_ready, &cache_lock);
+		}
+		sector = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % READ_AHEAD_QUEUE;
+		ra_queued--;
+
+		cache_get (sector, true, &hit);
+		if (!hit)
+			read_ahead_cnt++;
+	}
+}
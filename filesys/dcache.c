@@ -0,0 +1,172 @@
+/* dcache.c: Cache of directory entries.
+ *
+ * Looking up a name in a directory reads the directory's slots through
+ * the buffer cache.  The dentry cache remembers the outcome of recent
+ * lookups, keyed by the directory's inode sector and the name: the inode
+ * sector the name refers to, or, for a negative entry, that the name does
+ * not exist, so that creating a file right after finding it missing does
+ * not search again either.
+ *
+ * The cache holds at most DCACHE_SIZE entries and drops the least
+ * recently used one to make room.  directory.c keeps it in step with the
+ * directories: dir_add() and dir_remove() replace the entry for their
+ * name, and the entries of a directory go away with the directory itself
+ * (see inode_close()). */
+
+#include "filesys/dcache.h"
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of cached entries. */
+#define DCACHE_SIZE 128
+
+/* A cached directory entry. */
+struct dentry {
+	struct hash_elem hash_elem;     /* Element in DENTRIES. */
+	struct list_elem lru_elem;      /* Element in LRU. */
+	disk_sector_t dir;              /* Inode sector of the directory. */
+	char name[NAME_MAX + 1];        /* Name looked up in DIR. */
+	bool exists;                    /* False for a negative entry. */
+	disk_sector_t sector;           /* Inode sector of NAME, if EXISTS. */
+};
+
+static struct hash dentries;        /* Entries by directory and name. */
+static struct list lru;             /* Entries, most recently used first. */
+static size_t dentry_cnt;
+static struct lock dcache_lock;
+
+/* Returns a hash value for dentry D. */
+static uint64_t
+dentry_hash (const struct hash_elem *d_, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (d_, struct dentry, hash_elem);
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void) {
+	hash_init (&dentries, dentry_hash, dentry_less, NULL);
+	list_init (&lru);
+	lock_init (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or NULL.  DCACHE_LOCK must be
+ * held. */
+static struct dentry *
+dentry_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dentries, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops entry D.  DCACHE_LOCK must be held. */
+static void
+dentry_remove (struct dentry *d) {
+	hash_delete (&dentries, &d->hash_elem);
+	list_remove (&d->lru_elem);
+	dentry_cnt--;
+	free (d);
+}
+
+/* Looks NAME up in DIR in the cache.  Returns false if the cache knows
+ * nothing about it.  Otherwise returns true and sets *EXISTS to whether
+ * NAME exists, and if so *SECTOR to its inode sector. */
+bool
+dcache_lookup (disk_sector_t dir, const char *name, bool *exists,
+		disk_sector_t *sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return false;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_front (&lru, &d->lru_elem);
+		*exists = d->exists;
+		*sector = d->sector;
+	}
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Records that NAME in DIR refers to the inode at SECTOR if EXISTS is
+ * true, or that it does not exist otherwise. */
+static void
+dcache_set (disk_sector_t dir, const char *name, bool exists,
+		disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL)
+		list_remove (&d->lru_elem);
+	else {
+		if (dentry_cnt >= DCACHE_SIZE)
+			dentry_remove (list_entry (list_back (&lru), struct dentry,
+						lru_elem));
+		d = malloc (sizeof *d);
+		if (d == NULL) {
+			lock_release (&dcache_lock);
+			return;
+		}
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dentries, &d->hash_elem);
+		dentry_cnt++;
+	}
+	d->exists = exists;
+	d->sector = sector;
+	list_push_front (&lru, &d->lru_elem);
+	lock_release (&dcache_lock);
+}
+
+/* Records that NAME in DIR refers to the inode at SECTOR. */
+void
+dcache_add (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	dcache_set (dir, name, true, sector);
+}
+
+/* Records that there is no NAME in DIR. */
+void
+dcache_add_negative (disk_sector_t dir, const char *name) {
+	dcache_set (dir, name, false, 0);
+}
+
+/* Drops all entries for directory DIR, which is going away. */
+void
+dcache_forget_dir (disk_sector_t dir) {
+	struct list_elem *e, *next;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&lru); e != list_end (&lru); e = next) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		next = list_next (e);
+		if (d->dir == dir)
+			dentry_remove (d);
+	}
+	lock_release (&dcache_lock);
+}
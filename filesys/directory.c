@@ -1,11 +1,37 @@
 #include "filesys/directory.h"
+#include <hash.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Directories are hash tables.
+ *
+ * The entries of a directory are slots of a hash table kept in the
+ * directory file itself, with open addressing: an entry goes into the
+ * first slot not in use from the one its name hashes to on, wrapping
+ * around.  Every entry sits at most MAX_PROBE slots away from that home
+ * slot, so that a lookup reads at most that many slots, and stops early
+ * at a slot that was never used.  A removed entry leaves a tombstone
+ * behind that lookups probe past and insertions reuse.
+ *
+ * When an insertion finds no free slot within reach, the table is
+ * rebuilt with twice the slots.  Rebuilding costs a pass over all
+ * entries, but as the size doubles each time, that is O(1) per
+ * insertion on average.
+ *
+ * The public operations on a directory hold its directory lock (see
+ * inode_lock_dir()) throughout, so that they see and leave its table in a
+ * consistent state.  Operations on different directories proceed in
+ * parallel. */
+#define MAX_PROBE 8
+
+/* Number of slots of a directory rebuilt from an empty one. */
+#define MIN_SLOTS 16
+
 /* A directory. */
 struct dir {
 	struct inode *inode;                /* Backing store. */
@@ -17,6 +43,7 @@ struct dir_entry {
 	disk_sector_t inode_sector;         /* Sector number of header. */
 	char name[NAME_MAX + 1];            /* Null terminated file name. */
 	bool in_use;                        /* In use or free? */
+	bool removed;                       /* Free, but was in use? */
 };
 
 /* Creates a directory with space for ENTRY_CNT entries in the
@@ -32,6 +59,7 @@ struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
 	if (inode != NULL && dir != NULL) {
+		inode_mark_metadata (inode);
 		dir->inode = inode;
 		dir->pos = 0;
 		return dir;
@@ -71,6 +99,18 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+/* Returns the number of entry slots of DIR. */
+static size_t
+dir_slots (const struct dir *dir) {
+	return inode_length (dir->inode) / sizeof (struct dir_entry);
+}
+
+/* Returns the home slot of NAME in a table of SLOTS slots. */
+static size_t
+home_slot (const char *name, size_t slots) {
+	return hash_string (name) % slots;
+}
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
@@ -80,13 +120,21 @@ static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
 	struct dir_entry e;
-	size_t ofs;
+	size_t slots, slot;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
+	slots = dir_slots (dir);
+	if (slots == 0)
+		return false;
+	slot = home_slot (name, slots);
+	for (size_t i = 0; i < MAX_PROBE && i < slots; i++) {
+		off_t ofs = slot * sizeof e;
+
+		if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+				|| (!e.in_use && !e.removed))
+			break;
 		if (e.in_use && !strcmp (name, e.name)) {
 			if (ep != NULL)
 				*ep = e;
@@ -94,9 +142,69 @@ lookup (const struct dir *dir, const char *name,
 				*ofsp = ofs;
 			return true;
 		}
+		slot = (slot + 1) % slots;
+	}
 	return false;
 }
 
+/* Puts E into a free slot of TABLE, which has SLOTS slots, within reach
+ * of its home slot.  Returns false if there is none. */
+static bool
+table_insert (struct dir_entry *table, size_t slots,
+		const struct dir_entry *e) {
+	size_t slot = home_slot (e->name, slots);
+
+	for (size_t i = 0; i < MAX_PROBE && i < slots; i++) {
+		if (!table[slot].in_use) {
+			table[slot] = *e;
+			return true;
+		}
+		slot = (slot + 1) % slots;
+	}
+	return false;
+}
+
+/* Rebuilds the hash table of DIR with at least twice as many slots,
+ * dropping its tombstones.  Returns false if out of memory or disk
+ * space. */
+static bool
+dir_grow (struct dir *dir) {
+	size_t old_slots = dir_slots (dir);
+	size_t slots = old_slots < MIN_SLOTS / 2 ? MIN_SLOTS : old_slots * 2;
+	struct dir_entry *old = NULL, *table = NULL;
+	bool success = false;
+
+	if (old_slots > 0) {
+		old = malloc (old_slots * sizeof *old);
+		if (old == NULL)
+			return false;
+		if (inode_read_at (dir->inode, old, old_slots * sizeof *old, 0)
+				!= (off_t) (old_slots * sizeof *old))
+			goto done;
+	}
+
+	for (;; slots *= 2) {
+		size_t i;
+
+		table = calloc (slots, sizeof *table);
+		if (table == NULL)
+			goto done;
+		for (i = 0; i < old_slots; i++)
+			if (old[i].in_use && !table_insert (table, slots, &old[i]))
+				break;
+		if (i == old_slots)
+			break;
+		free (table);
+	}
+	success = inode_write_at (dir->inode, table, slots * sizeof *table, 0)
+		== (off_t) (slots * sizeof *table);
+
+done:
+	free (table);
+	free (old);
+	return success;
+}
+
 /* Searches DIR for a file with the given NAME
  * and returns true if one exists, false otherwise.
  * On success, sets *INODE to an inode for the file, otherwise to
@@ -104,15 +212,25 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t dir_sector, sector;
 	struct dir_entry e;
+	bool exists;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	dir_sector = inode_get_inumber (dir->inode);
+	inode_lock_dir (dir->inode);
+	if (!dcache_lookup (dir_sector, name, &exists, &sector)) {
+		exists = lookup (dir, name, &e, NULL);
+		if (exists) {
+			sector = e.inode_sector;
+			dcache_add (dir_sector, name, sector);
+		} else
+			dcache_add_negative (dir_sector, name);
+	}
+	*inode = exists ? inode_open (sector) : NULL;
+	inode_unlock_dir (dir->inode);
 
 	return *inode != NULL;
 }
@@ -126,7 +244,9 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	struct dir_entry e;
+	disk_sector_t sector;
 	off_t ofs;
+	bool exists;
 	bool success = false;
 
 	ASSERT (dir != NULL);
@@ -136,29 +256,46 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
-	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
-		goto done;
-
-	/* Set OFS to offset of free slot.
-	 * If there are no free slots, then it will be set to the
-	 * current end-of-file.
+	inode_lock_dir (dir->inode);
 
-	 * inode_read_at() will only return a short read at end of file.
-	 * Otherwise, we'd need to verify that we didn't get a short
-	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
-			break;
+	/* Check that NAME is not in use, unless the dentry cache knows it is
+	 * not. */
+	if (!dcache_lookup (inode_get_inumber (dir->inode), name, &exists, &sector)
+			? lookup (dir, name, NULL, NULL) : exists)
+		goto done;
 
-	/* Write slot. */
 	e.in_use = true;
+	e.removed = false;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
-	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+	/* Take the first free slot within reach of the home slot, making
+	 * room if there is none. */
+	for (;;) {
+		size_t slots = dir_slots (dir);
+		size_t slot = slots > 0 ? home_slot (name, slots) : 0;
+		struct dir_entry old;
+
+		for (size_t i = 0; i < MAX_PROBE && i < slots; i++) {
+			ofs = slot * sizeof old;
+			if (inode_read_at (dir->inode, &old, sizeof old, ofs) != sizeof old)
+				goto done;
+			if (!old.in_use) {
+				success = inode_write_at (dir->inode, &e, sizeof e, ofs)
+					== sizeof e;
+				if (success)
+					dcache_add (inode_get_inumber (dir->inode), name,
+							inode_sector);
+				goto done;
+			}
+			slot = (slot + 1) % slots;
+		}
+		if (!dir_grow (dir))
+			goto done;
+	}
 
 done:
+	inode_unlock_dir (dir->inode);
 	return success;
 }
 
@@ -175,6 +312,8 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	inode_lock_dir (dir->inode);
+
 	/* Find directory entry. */
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
@@ -184,16 +323,19 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode == NULL)
 		goto done;
 
-	/* Erase directory entry. */
+	/* Erase directory entry, leaving a tombstone. */
 	e.in_use = false;
+	e.removed = true;
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
 	/* Remove inode. */
 	inode_remove (inode);
+	dcache_add_negative (inode_get_inumber (dir->inode), name);
 	success = true;
 
 done:
+	inode_unlock_dir (dir->inode);
 	inode_close (inode);
 	return success;
 }
@@ -204,13 +346,17 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
+	inode_lock_dir (dir->inode);
+	while (!found
+			&& inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
 		}
 	}
-	return false;
+	inode_unlock_dir (dir->inode);
+	return found;
 }
@@ -1,6 +1,8 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include <stdio.h>
@@ -22,14 +24,20 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
-	struct lock write_lock;
+	cluster_t last_clst;            /* Next-fit cursor: the cluster after
+	                                   the last one allocated. */
+	struct bitmap *used;            /* Clusters in use, one bit each. */
+	struct lock write_lock;         /* Serializes changes to the FAT, the
+	                                   bitmap and the cursor.  Lookups of
+	                                   single entries go without it. */
 };
 
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_build_used (void);
+static void fat_sync (cluster_t first, cluster_t last);
 
 void
 fat_init (void) {
@@ -53,6 +61,9 @@ fat_init (void) {
 
 void
 fat_open (void) {
+	/* Drop the table fat_create() made when formatting: it was written
+	 * out and is read back below. */
+	free (fat_fs->fat);
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
@@ -78,6 +89,7 @@ fat_open (void) {
 			free (bounce);
 		}
 	}
+	fat_build_used ();
 }
 
 void
@@ -125,6 +137,7 @@ fat_create (void) {
 		PANIC ("FAT creation failed");
 
 	// Set up ROOT_DIR_CLST
+	fat_build_used ();
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
@@ -137,13 +150,15 @@ fat_create (void) {
 
 void
 fat_boot_create (void) {
+	/* The journal takes the end of the disk. */
+	disk_sector_t total = journal_region ();
 	unsigned int fat_sectors =
-	    (disk_size (filesys_disk) - 1)
+	    (total - 1)
 	    / (DISK_SECTOR_SIZE / sizeof (cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
 	fat_fs->bs = (struct fat_boot){
 	    .magic = FAT_MAGIC,
 	    .sectors_per_cluster = SECTORS_PER_CLUSTER,
-	    .total_sectors = disk_size (filesys_disk),
+	    .total_sectors = total,
 	    .fat_start = 1,
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
@@ -152,42 +167,179 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	/* Clusters are numbered from 1, so the FAT has one entry more than
+	 * there are clusters in the data area. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Builds the bitmap of clusters in use from the FAT.  Cluster 0 does
+ * not exist and counts as used. */
+static void
+fat_build_used (void) {
+	bitmap_destroy (fat_fs->used);
+	fat_fs->used = bitmap_create (fat_fs->fat_length);
+	if (fat_fs->used == NULL)
+		PANIC ("FAT bitmap creation failed");
+	bitmap_mark (fat_fs->used, 0);
+	for (cluster_t c = 1; c < fat_fs->fat_length; c++)
+		if (fat_fs->fat[c] != 0)
+			bitmap_mark (fat_fs->used, c);
+}
+
+/* Writes the sectors of the FAT that hold the entries of clusters FIRST
+ * through LAST through the journal.  Between fat_open() and fat_close(),
+ * this keeps the FAT on disk in step with the one in memory. */
+static void
+fat_sync (cluster_t first, cluster_t last) {
+	const size_t per_sector = DISK_SECTOR_SIZE / sizeof (cluster_t);
+	const size_t fat_bytes = fat_fs->fat_length * sizeof (cluster_t);
+
+	for (size_t i = first / per_sector; i <= last / per_sector; i++) {
+		size_t ofs = i * DISK_SECTOR_SIZE;
+		size_t size = fat_bytes - ofs < DISK_SECTOR_SIZE
+			? fat_bytes - ofs : DISK_SECTOR_SIZE;
+		journal_write (fat_fs->bs.fat_start + i, (uint8_t *) fat_fs->fat + ofs,
+				0, size);
+	}
+}
+
+/* Returns the number of free clusters from START on, up to CNT. */
+static size_t
+free_run_length (size_t start, size_t cnt) {
+	size_t n = 0;
+	while (n < cnt && start + n < fat_fs->fat_length
+			&& !bitmap_test (fat_fs->used, start + n))
+		n++;
+	return n;
+}
+
+/* Returns the first free cluster of a run of CNT free clusters at or
+ * after the next-fit cursor, wrapping around to the start of the disk,
+ * or BITMAP_ERROR if there is no such run. */
+static size_t
+find_free_run (size_t cnt) {
+	size_t start = bitmap_scan (fat_fs->used, fat_fs->last_clst, cnt, false);
+	if (start == BITMAP_ERROR)
+		start = bitmap_scan (fat_fs->used, 1, cnt, false);
+	return start;
+}
+
+/* Adds up to CNT clusters to the chain that ends at CLST, or starts a new
+ * chain if CLST is 0, and stores the first of them into *FIRST.  The
+ * clusters right after CLST are taken if they are free, and otherwise a
+ * run of CNT consecutive free clusters from the next-fit cursor on; when
+ * there is no such run, the first free cluster and those free right after
+ * it.  Returns the number of clusters added, 0 if the disk is full. */
+size_t
+fat_create_run (cluster_t clst, size_t cnt, cluster_t *first) {
+	size_t start = BITMAP_ERROR, n = 0;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&fat_fs->write_lock);
+	if (clst != 0 && (n = free_run_length (clst + 1, cnt)) > 0)
+		start = clst + 1;
+	else if ((start = find_free_run (cnt)) != BITMAP_ERROR)
+		n = cnt;
+	else if ((start = find_free_run (1)) != BITMAP_ERROR)
+		n = free_run_length (start, cnt);
+
+	if (start != BITMAP_ERROR) {
+		bitmap_set_multiple (fat_fs->used, start, n, true);
+		for (size_t i = 0; i + 1 < n; i++)
+			fat_fs->fat[start + i] = start + i + 1;
+		fat_fs->fat[start + n - 1] = EOChain;
+		fat_sync (start, start + n - 1);
+		if (clst != 0) {
+			fat_fs->fat[clst] = start;
+			fat_sync (clst, clst);
+		}
+		fat_fs->last_clst = start + n < fat_fs->fat_length ? start + n : 1;
+		*first = start;
+	}
+	lock_release (&fat_fs->write_lock);
+	return n;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new_clst;
+
+	if (fat_create_run (clst, 1, &new_clst) == 0)
+		return 0;
+	return new_clst;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	const size_t per_sector = DISK_SECTOR_SIZE / sizeof (cluster_t);
+	cluster_t dirty = 0;
+
+	lock_acquire (&fat_fs->write_lock);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_fs->fat[clst];
+		fat_fs->fat[clst] = 0;
+		bitmap_reset (fat_fs->used, clst);
+		for (size_t i = 0; i < SECTORS_PER_CLUSTER; i++)
+			journal_revoke (cluster_to_sector (clst) + i);
+
+		/* Write each FAT sector once it is done with, which for a
+		 * contiguous chain is once per sector. */
+		if (dirty != 0 && dirty / per_sector != clst / per_sector)
+			fat_sync (dirty, dirty);
+		dirty = clst;
+		clst = next;
+	}
+	if (dirty != 0)
+		fat_sync (dirty, dirty);
+	if (pclst != 0) {
+		fat_fs->fat[pclst] = EOChain;
+		fat_sync (pclst, pclst);
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	lock_acquire (&fat_fs->write_lock);
+	fat_fs->fat[clst] = val;
+	bitmap_set (fat_fs->used, clst, val != 0);
+	fat_sync (clst, clst);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Converts a sector number in the data area to the # of its cluster. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
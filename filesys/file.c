@@ -1,13 +1,23 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/disk.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bounds of the read-ahead window of a file read sequentially.  The
+ * window starts small on the first sequential read and doubles on each
+ * one after it. */
+#define READ_AHEAD_MIN (4 * DISK_SECTOR_SIZE)
+#define READ_AHEAD_MAX (16 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+	off_t ra_last;              /* End of the last file_read(). */
+	off_t ra_window;            /* Read-ahead window, 0 if not sequential. */
+	off_t ra_end;               /* End of what has been read ahead. */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -64,6 +74,29 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Notes that the bytes of FILE from START to END were just read by
+ * file_read().  A read that picks up where the last one ended grows the
+ * read-ahead window and keeps that much of the file being read ahead of
+ * the reader; any other read closes the window. */
+static void
+file_read_ahead (struct file *file, off_t start, off_t end) {
+	if (start != file->ra_last)
+		file->ra_window = 0;
+	else if (file->ra_window == 0)
+		file->ra_window = READ_AHEAD_MIN;
+	else if (file->ra_window < READ_AHEAD_MAX)
+		file->ra_window *= 2;
+	file->ra_last = end;
+
+	if (file->ra_window == 0 || file->ra_end < end)
+		file->ra_end = end;
+	if (file->ra_window > 0 && file->ra_end < end + file->ra_window) {
+		inode_read_ahead (file->inode, file->ra_end,
+				end + file->ra_window - file->ra_end);
+		file->ra_end = end + file->ra_window;
+	}
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -72,6 +105,8 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	if (bytes_read > 0)
+		file_read_ahead (file, file->pos, file->pos + bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -89,9 +124,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
+ * A write past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
@@ -103,9 +137,8 @@ file_write (struct file *file, const void *buffer, off_t size) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk is full.
+ * A write past end of file grows the file.
  * The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
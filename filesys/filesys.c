@@ -2,15 +2,50 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
+#ifdef VM
+#include "filesys/page_cache.h"
+#endif
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
 
+/* Locking.
+ *
+ * There is no lock over the file system as a whole: each structure has
+ * its own lock, and operations on different files and directories run in
+ * parallel.  A thread that holds more than one of these locks must have
+ * taken them in this order:
+ *
+ *   1. The directory lock of a directory (inode_lock_dir()), while
+ *      looking up, adding or removing an entry.  One at a time.
+ *   2. The readers-writer lock of an inode, held while reading or
+ *      writing its data, exclusively while the file grows and while its
+ *      pages are dropped from the page cache.
+ *   3. The free map lock, or the FAT lock, while allocating or freeing
+ *      sectors.  Writing the free map out then takes the locks of its
+ *      own inode, the only inode locks that may come after these.
+ *   4. The page cache lock, with VM only, held while looking a page up
+ *      in the page cache or adding one to it, and while evicting one.
+ *      The evictor only tries to take it.
+ *   5. The block map lock of an inode.
+ *   6. The journal lock, while adding to the running transaction or
+ *      committing it.
+ *   7. The inode table lock, the dentry cache lock and the buffer cache
+ *      lock, which are never held while taking another.
+ *
+ * Data are copied into and out of the page cache, and read into it from
+ * disk, under the readers-writer lock of their inode alone, so I/O on
+ * different files runs in parallel.  Nothing waits for disk I/O with a
+ * lock of the inode table or of a block map held. */
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -21,7 +56,10 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init ();
 	inode_init ();
+	dcache_init ();
+	journal_init (format);
 
 #ifdef EFILESYS
 	fat_init ();
@@ -45,12 +83,16 @@ filesys_init (bool format) {
  * to disk. */
 void
 filesys_done (void) {
+#ifdef VM
+	page_cache_flush ();
+#endif
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
 	free_map_close ();
 #endif
+	journal_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -61,12 +103,16 @@ bool
 filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
 	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
+	bool success;
+
+	journal_begin ();
+	success = (dir != NULL
 			&& free_map_allocate (1, &inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
+	journal_end ();
 	dir_close (dir);
 
 	return success;
@@ -96,7 +142,11 @@ filesys_open (const char *name) {
 bool
 filesys_remove (const char *name) {
 	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+	bool success;
+
+	journal_begin ();
+	success = dir != NULL && dir_remove (dir, name);
+	journal_end ();
 	dir_close (dir);
 
 	return success;
@@ -110,6 +160,8 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
@@ -117,6 +169,7 @@ do_format (void) {
 		PANIC ("root directory creation failed");
 	free_map_close ();
 #endif
+	journal_done ();
 
 	printf ("done.\n");
 }
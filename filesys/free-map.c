@@ -1,21 +1,64 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include "filesys/fat.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
+#ifdef EFILESYS
+/* With the FAT file system, the FAT keeps track of free space, and inode
+ * sectors are clusters of their own, each a chain of one. */
+
+/* Allocates CNT consecutive sectors and stores the first into *SECTORP.
+ * Only single sectors can be allocated this way from the FAT.
+ * Returns true if successful, false if the disk is full. */
+bool
+free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
+	ASSERT (cnt == 1);
+
+	cluster_t clst = fat_create_chain (0);
+	if (clst == 0)
+		return false;
+	*sectorp = cluster_to_sector (clst);
+	return true;
+}
+
+/* Makes CNT sectors starting at SECTOR, allocated with
+ * free_map_allocate(), available for use. */
+void
+free_map_release (disk_sector_t sector, size_t cnt) {
+	for (size_t i = 0; i < cnt; i++)
+		fat_remove_chain (sector_to_cluster (sector + i), 0);
+}
+#else
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct lock free_map_lock;    /* Protects the two above. */
+
+/* Opens the free map file.  Its data are metadata, written through the
+ * journal. */
+static struct file *
+free_map_file_open (void) {
+	struct inode *inode = inode_open (FREE_MAP_SECTOR);
+
+	if (inode != NULL)
+		inode_mark_metadata (inode);
+	return file_open (inode);
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) {
+	lock_init (&free_map_lock);
 	free_map = bitmap_create (disk_size (filesys_disk));
 	if (free_map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	bitmap_set_multiple (free_map, journal_region (), JOURNAL_SECTORS, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,6 +67,7 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
+	lock_acquire (&free_map_lock);
 	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
 	if (sector != BITMAP_ERROR
 			&& free_map_file != NULL
@@ -31,23 +75,74 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
 		bitmap_set_multiple (free_map, sector, cnt, false);
 		sector = BITMAP_ERROR;
 	}
+	lock_release (&free_map_lock);
 	if (sector != BITMAP_ERROR)
 		*sectorp = sector;
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates up to CNT consecutive sectors from the free map, as close
+ * after sector HINT as possible, and stores the first into *SECTORP.  A
+ * run of all CNT sectors is preferred; if there is none, the first free
+ * sector after HINT is taken along with the free sectors that follow it.
+ * Returns the number of sectors allocated, 0 if the disk is full. */
+size_t
+free_map_allocate_near (disk_sector_t hint, size_t cnt,
+		disk_sector_t *sectorp) {
+	size_t size = bitmap_size (free_map);
+	size_t sector;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&free_map_lock);
+	if (hint >= size)
+		hint = 0;
+	sector = bitmap_scan (free_map, hint, cnt, false);
+	if (sector == BITMAP_ERROR)
+		sector = bitmap_scan (free_map, 0, cnt, false);
+	if (sector == BITMAP_ERROR) {
+		size_t run = 1;
+
+		sector = bitmap_scan (free_map, hint, 1, false);
+		if (sector == BITMAP_ERROR)
+			sector = bitmap_scan (free_map, 0, 1, false);
+		if (sector == BITMAP_ERROR) {
+			lock_release (&free_map_lock);
+			return 0;
+		}
+		while (run < cnt && sector + run < size
+				&& !bitmap_test (free_map, sector + run))
+			run++;
+		cnt = run;
+	}
+
+	bitmap_set_multiple (free_map, sector, cnt, true);
+	if (free_map_file != NULL && !bitmap_write (free_map, free_map_file)) {
+		bitmap_set_multiple (free_map, sector, cnt, false);
+		cnt = 0;
+	}
+	lock_release (&free_map_lock);
+	if (cnt > 0)
+		*sectorp = sector;
+	return cnt;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
 	bitmap_write (free_map, free_map_file);
+	for (size_t i = 0; i < cnt; i++)
+		journal_revoke (sector + i);
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void) {
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+	free_map_file = free_map_file_open ();
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
 	if (!bitmap_read (free_map, free_map_file))
@@ -69,9 +164,10 @@ free_map_create (void) {
 		PANIC ("free map creation failed");
 
 	/* Write bitmap to file. */
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+	free_map_file = free_map_file_open ();
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
 }
+#endif
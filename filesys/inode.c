@@ -1,23 +1,67 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/dcache.h"
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef VM
+#include "filesys/page_cache.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of consecutive data sectors of a file. */
+struct extent {
+	uint32_t first;                     /* Index in the file of its first
+	                                       sector. */
+	disk_sector_t start;                /* First disk sector. */
+	uint32_t length;                    /* Number of sectors. */
+};
+
+#ifdef EFILESYS
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The data are kept in a chain of clusters in the FAT. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
+	cluster_t start;                    /* First data cluster, or 0. */
 	uint32_t unused[125];               /* Not used. */
 };
+#else
+/* Number of extents kept in the inode itself, and in the overflow
+ * block once those are used up. */
+#define INODE_EXTENTS 41
+#define OVERFLOW_EXTENTS 42
+#define MAX_EXTENTS (INODE_EXTENTS + OVERFLOW_EXTENTS)
+
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct inode_disk {
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t extent_cnt;                /* Number of extents in use. */
+	disk_sector_t overflow;             /* Overflow block sector, or 0. */
+	struct extent extents[INODE_EXTENTS]; /* Extents, in file order. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* Extents of a file beyond the first INODE_EXTENTS.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block {
+	struct extent extents[OVERFLOW_EXTENTS];
+	uint32_t unused[2];                 /* Not used. */
+};
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -26,37 +70,440 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+ *
+ * OPEN_CNT, REMOVED and DENY_WRITE_CNT are protected by INODE_TABLE_LOCK.
+ * RW is held for reading by readers and writers within the file, and for
+ * writing while the file grows, so that its length only changes with the
+ * rest of the inode out of the way.  MAP_LOCK protects the block map, which
+ * the page cache also walks, with no RW held, to write back and read in
+ * pages.  DIR_LOCK serializes the operations on a directory; see
+ * directory.c.  The order the locks are taken in is in filesys.c.
+ *
+ * The data of a METADATA inode, a directory or the free map, are written
+ * through the journal, like the inodes themselves, and never go through
+ * the page cache. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem hash_elem;         /* Element in the inode table. */
+	struct list_elem lru_elem;          /* Element in CLOSED_INODES. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	bool metadata;                      /* Data written through the journal? */
+	struct rwlock rw;                   /* Data and length. */
+	struct lock map_lock;               /* Block map. */
+	struct lock dir_lock;               /* Directory entries. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	struct extent *runs;                /* Cluster chain cache, see below. */
+	size_t run_cnt;                     /* Number of RUNS. */
+	size_t run_cap;                     /* Number of RUNS allocated. */
+#else
+	struct extent_block *overflow;      /* Overflow extents, or NULL. */
+#endif
 };
 
+#ifdef EFILESYS
+/* Cluster chain cache.
+ *
+ * Finding the cluster at some offset of a file means following its chain
+ * in the FAT from the head, one link per cluster.  Instead, each open
+ * inode keeps the part of its chain walked so far as a list of runs of
+ * consecutive clusters, in the form of extents, so that a lookup is a
+ * binary search over the runs, and the chain is only followed past its
+ * last cached cluster, once. */
+
+/* Returns run IDX of INODE. */
+static struct extent *
+inode_extent (const struct inode *inode, size_t idx) {
+	ASSERT (idx < inode->run_cnt);
+	return &inode->runs[idx];
+}
+
+/* Returns the number of runs of INODE cached so far. */
+static size_t
+inode_extent_cnt (const struct inode *inode) {
+	return inode->run_cnt;
+}
+
+/* Appends the cluster at disk sector SECTOR, sector IDX of INODE, to its
+ * cached runs.  Returns false if out of memory. */
+static bool
+chain_cache_append (struct inode *inode, uint32_t idx, disk_sector_t sector) {
+	struct extent *last = inode->run_cnt > 0
+		? &inode->runs[inode->run_cnt - 1] : NULL;
+
+	if (last != NULL && sector == last->start + last->length) {
+		last->length += SECTORS_PER_CLUSTER;
+		return true;
+	}
+	if (inode->run_cnt == inode->run_cap) {
+		size_t cap = inode->run_cap > 0 ? inode->run_cap * 2 : 4;
+		struct extent *runs = realloc (inode->runs, cap * sizeof *runs);
+		if (runs == NULL)
+			return false;
+		inode->runs = runs;
+		inode->run_cap = cap;
+	}
+	inode->runs[inode->run_cnt++] = (struct extent) {
+		.first = idx, .start = sector, .length = SECTORS_PER_CLUSTER };
+	return true;
+}
+
+/* Returns the last cluster of INODE's chain cached so far, or 0. */
+static cluster_t
+chain_cache_last (const struct inode *inode) {
+	const struct extent *last;
+
+	if (inode->run_cnt == 0)
+		return 0;
+	last = &inode->runs[inode->run_cnt - 1];
+	return sector_to_cluster (last->start + last->length - 1);
+}
+
+/* Returns the number of sectors of INODE covered by its cached runs. */
+static uint32_t
+chain_cache_sectors (const struct inode *inode) {
+	const struct extent *last;
+
+	if (inode->run_cnt == 0)
+		return 0;
+	last = &inode->runs[inode->run_cnt - 1];
+	return last->first + last->length;
+}
+
+/* Follows INODE's chain until sector IDX is cached, or to its end if IDX
+ * is UINT32_MAX.  Returns false if the chain ends before IDX or memory
+ * runs out. */
+static bool
+chain_cache_fill (struct inode *inode, uint32_t idx) {
+	uint32_t have = chain_cache_sectors (inode);
+	cluster_t clst;
+
+	if (idx < have)
+		return true;
+	clst = have == 0 ? inode->data.start : fat_get (chain_cache_last (inode));
+	for (; have <= idx; have += SECTORS_PER_CLUSTER) {
+		if (clst == 0 || clst == EOChain)
+			return false;
+		if (!chain_cache_append (inode, have, cluster_to_sector (clst)))
+			return false;
+		clst = fat_get (clst);
+	}
+	return true;
+}
+#else
+/* Returns extent IDX of INODE. */
+static struct extent *
+inode_extent (const struct inode *inode, size_t idx) {
+	ASSERT (idx < inode->data.extent_cnt);
+	if (idx < INODE_EXTENTS)
+		return (struct extent *) &inode->data.extents[idx];
+	return &inode->overflow->extents[idx - INODE_EXTENTS];
+}
+
+/* Returns the number of extents of INODE. */
+static size_t
+inode_extent_cnt (const struct inode *inode) {
+	return inode->data.extent_cnt;
+}
+#endif
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	disk_sector_t sector = -1;
+	size_t lo = 0, hi;
+	uint32_t idx;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= inode->data.length)
 		return -1;
+	idx = pos / DISK_SECTOR_SIZE;
+
+	lock_acquire (&inode->map_lock);
+#ifdef EFILESYS
+	if (!chain_cache_fill (inode, idx))
+		goto done;
+#endif
+
+	/* Binary search for the extent that holds sector IDX. */
+	hi = inode_extent_cnt (inode);
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		const struct extent *e = inode_extent (inode, mid);
+
+		if (idx < e->first)
+			hi = mid;
+		else if (idx >= e->first + e->length)
+			lo = mid + 1;
+		else {
+			sector = e->start + (idx - e->first);
+			break;
+		}
+	}
+#ifdef EFILESYS
+done:
+#endif
+	lock_release (&inode->map_lock);
+	return sector;
+}
+
+#ifdef EFILESYS
+/* Adds clusters to INODE's chain so that it can hold LENGTH bytes,
+ * filling them with zeros.  The clusters are asked for all at once, so
+ * that they come in as few runs of consecutive clusters as the free space
+ * allows.  Returns false if the disk filled up, in which case INODE keeps
+ * the clusters added so far.  Only one thread may extend INODE at a
+ * time; the map lock is only held to change the chain cache. */
+static bool
+inode_extend (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t want = DIV_ROUND_UP (bytes_to_sectors (length), SECTORS_PER_CLUSTER);
+	size_t have;
+	cluster_t last;
+	bool success = true;
+
+	/* Nothing may be past the end of the cache when adding to the chain. */
+	lock_acquire (&inode->map_lock);
+	chain_cache_fill (inode, UINT32_MAX);
+	have = chain_cache_sectors (inode) / SECTORS_PER_CLUSTER;
+	last = chain_cache_last (inode);
+	lock_release (&inode->map_lock);
+
+	while (have < want) {
+		cluster_t clst;
+		size_t cnt = fat_create_run (last, want - have, &clst);
+
+		if (cnt == 0)
+			return false;
+		if (inode->data.start == 0)
+			inode->data.start = clst;
+		for (size_t i = 0; i < cnt * SECTORS_PER_CLUSTER; i++)
+			buffer_cache_write (cluster_to_sector (clst) + i, zeros, 0,
+					DISK_SECTOR_SIZE);
+		last = clst + cnt - 1;
+
+		lock_acquire (&inode->map_lock);
+		for (size_t i = 0; i < cnt && success; i++, have++) {
+			if (!chain_cache_append (inode, have * SECTORS_PER_CLUSTER,
+						cluster_to_sector (clst + i))) {
+				/* Drop the cache; it is filled again from the FAT. */
+				free (inode->runs);
+				inode->runs = NULL;
+				inode->run_cnt = inode->run_cap = 0;
+				success = false;
+			}
+		}
+		lock_release (&inode->map_lock);
+		if (!success)
+			return false;
+	}
+	return true;
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Writes INODE's on-disk inode. */
+static void
+inode_save (struct inode *inode) {
+	journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+}
+
+/* Releases the data clusters of INODE. */
+static void
+inode_release_blocks (struct inode *inode) {
+	if (inode->data.start != 0)
+		fat_remove_chain (inode->data.start, 0);
+}
+
+/* Sets up the in-memory block map of INODE, just read from disk.  The
+ * chain cache starts out empty. */
+static bool
+inode_load_map (struct inode *inode) {
+	inode->runs = NULL;
+	inode->run_cnt = inode->run_cap = 0;
+	return true;
+}
+
+/* Frees INODE's in-memory copy of its block map. */
+static void
+inode_free_map (struct inode *inode) {
+	free (inode->runs);
+}
+#else
+/* Allocates data sectors for INODE so that it can hold LENGTH bytes,
+ * filling them with zeros.  New sectors go right after the last extent
+ * when they are free, growing it, or as close after it as possible.  The
+ * extents are only changed in memory; see inode_save().  Returns false if
+ * the disk or the extent table filled up, in which case INODE keeps the
+ * sectors allocated so far.  Only one thread may extend INODE at a time;
+ * the map lock is only held to change the extents, not to allocate. */
+static bool
+inode_extend (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	struct inode_disk *data = &inode->data;
+	struct extent *last = NULL;
+	size_t have = 0, want = bytes_to_sectors (length);
+
+	if (data->extent_cnt > 0) {
+		last = inode_extent (inode, data->extent_cnt - 1);
+		have = last->first + last->length;
+	}
+
+	while (have < want) {
+		disk_sector_t hint = last != NULL ? last->start + last->length
+		                                  : inode->sector + 1;
+		disk_sector_t start, overflow = 0;
+		struct extent_block *block = NULL;
+		size_t cnt = free_map_allocate_near (hint, want - have, &start);
+
+		if (cnt == 0)
+			return false;
+		for (size_t i = 0; i < cnt; i++)
+			buffer_cache_write (start + i, zeros, 0, DISK_SECTOR_SIZE);
+
+		if (last == NULL || start != last->start + last->length) {
+			if (data->extent_cnt == INODE_EXTENTS && inode->overflow == NULL) {
+				block = calloc (1, sizeof *block);
+				if (block == NULL || !free_map_allocate (1, &overflow)) {
+					free (block);
+					free_map_release (start, cnt);
+					return false;
+				}
+			}
+			if (data->extent_cnt == MAX_EXTENTS) {
+				free_map_release (start, cnt);
+				return false;
+			}
+		}
+
+		/* The new sectors are past the end of file until the caller
+		 * updates the length, but the extents must look consistent at
+		 * all times to anyone looking up a sector within the file. */
+		lock_acquire (&inode->map_lock);
+		if (last != NULL && start == last->start + last->length)
+			last->length += cnt;
+		else {
+			if (block != NULL) {
+				inode->overflow = block;
+				data->overflow = overflow;
+			}
+			last = inode_extent (inode, data->extent_cnt++);
+			last->first = have;
+			last->start = start;
+			last->length = cnt;
+		}
+		lock_release (&inode->map_lock);
+		have += cnt;
+	}
+	return true;
+}
+
+/* Writes INODE's on-disk inode, and its overflow block if it has one. */
+static void
+inode_save (struct inode *inode) {
+	journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (inode->overflow != NULL)
+		journal_write (inode->data.overflow, inode->overflow, 0,
+				DISK_SECTOR_SIZE);
+}
+
+/* Releases the data sectors of INODE and its overflow block. */
+static void
+inode_release_blocks (struct inode *inode) {
+	for (size_t i = 0; i < inode->data.extent_cnt; i++) {
+		struct extent *e = inode_extent (inode, i);
+		free_map_release (e->start, e->length);
+	}
+	if (inode->overflow != NULL)
+		free_map_release (inode->data.overflow, 1);
+}
+
+/* Sets up the in-memory block map of INODE, just read from disk: reads
+ * its overflow block, if any.  Returns false if out of memory. */
+static bool
+inode_load_map (struct inode *inode) {
+	inode->overflow = NULL;
+	if (inode->data.overflow != 0) {
+		inode->overflow = malloc (sizeof *inode->overflow);
+		if (inode->overflow == NULL)
+			return false;
+		buffer_cache_read (inode->data.overflow, inode->overflow, 0,
+				DISK_SECTOR_SIZE);
+	}
+	return true;
+}
+
+/* Frees INODE's in-memory copy of its block map. */
+static void
+inode_free_map (struct inode *inode) {
+	free (inode->overflow);
+}
+#endif
+
+/* Inode table.
+ *
+ * In-memory inodes are kept in a hash table by sector, so that opening a
+ * single inode twice returns the same `struct inode'.  An inode closed by
+ * its last opener stays in the table for a while, with its on-disk inode
+ * and block map, on a list of closed inodes in LRU order: reopening it
+ * then reads nothing.  At most CLOSED_INODES_MAX of them are kept; the
+ * least recently closed one is freed to make room.  Removed inodes are
+ * freed as soon as they are closed.
+ *
+ * INODE_TABLE_LOCK protects the table, the list and the open counts.  It
+ * is never held across disk I/O. */
+#define CLOSED_INODES_MAX 64
+
+static struct hash inode_table;
+static struct list closed_inodes;    /* Most recently closed first. */
+static size_t closed_cnt;
+static struct lock inode_table_lock;
+
+/* Returns a hash value for inode I. */
+static uint64_t
+inode_hash (const struct hash_elem *i_, void *aux UNUSED) {
+	const struct inode *i = hash_entry (i_, struct inode, hash_elem);
+	return hash_int (i->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct inode *a = hash_entry (a_, struct inode, hash_elem);
+	const struct inode *b = hash_entry (b_, struct inode, hash_elem);
+	return a->sector < b->sector;
+}
+
+/* Adds an opener to INODE, taking it off the list of closed inodes if
+ * it was there, and returns it.  INODE_TABLE_LOCK must be held. */
+static struct inode *
+inode_get (struct inode *inode) {
+	ASSERT (lock_held_by_current_thread (&inode_table_lock));
+	if (inode->open_cnt++ == 0) {
+		list_remove (&inode->lru_elem);
+		closed_cnt--;
+	}
+	return inode;
+}
+
+/* Frees INODE, which is out of the inode table. */
+static void
+inode_free (struct inode *inode) {
+	inode_free_map (inode);
+	free (inode);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	hash_init (&inode_table, inode_hash, inode_less, NULL);
+	list_init (&closed_inodes);
+	lock_init (&inode_table_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -66,32 +513,31 @@ inode_init (void) {
  * Returns false if memory or disk allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
-	struct inode_disk *disk_inode = NULL;
+	struct inode *inode;
 	bool success = false;
 
 	ASSERT (length >= 0);
 
-	/* If this assertion fails, the inode structure is not exactly
-	 * one sector in size, and you should fix that. */
-	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
-
-	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
-		free (disk_inode);
+	/* If these assertions fail, the on-disk structures are not
+	 * exactly one sector in size, and you should fix that. */
+	ASSERT (sizeof (struct inode_disk) == DISK_SECTOR_SIZE);
+#ifndef EFILESYS
+	ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
+#endif
+
+	inode = calloc (1, sizeof *inode);
+	if (inode != NULL) {
+		inode->sector = sector;
+		lock_init (&inode->map_lock);
+		inode->data.magic = INODE_MAGIC;
+		if (inode_extend (inode, length)) {
+			inode->data.length = length;
+			inode_save (inode);
+			success = true;
+		} else
+			inode_release_blocks (inode);
+		inode_free_map (inode);
+		free (inode);
 	}
 	return success;
 }
@@ -101,39 +547,62 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
-	struct inode *inode;
-
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	struct inode key, *inode;
+	struct hash_elem *e;
+
+	/* Check whether this inode is in memory already. */
+	key.sector = sector;
+	lock_acquire (&inode_table_lock);
+	e = hash_find (&inode_table, &key.hash_elem);
+	if (e != NULL) {
+		inode = inode_get (hash_entry (e, struct inode, hash_elem));
+		lock_release (&inode_table_lock);
+		return inode;
 	}
+	lock_release (&inode_table_lock);
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
 	if (inode == NULL)
 		return NULL;
+	buffer_cache_read (sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (!inode_load_map (inode)) {
+		free (inode);
+		return NULL;
+	}
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->metadata = false;
+	rwlock_init (&inode->rw);
+	lock_init (&inode->map_lock);
+	lock_init (&inode->dir_lock);
+
+	/* Somebody else may have read it meanwhile. */
+	lock_acquire (&inode_table_lock);
+	e = hash_insert (&inode_table, &inode->hash_elem);
+	if (e != NULL) {
+		struct inode *other = inode_get (hash_entry (e, struct inode,
+					hash_elem));
+		lock_release (&inode_table_lock);
+		inode_free (inode);
+		return other;
+	}
+	lock_release (&inode_table_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
-		inode->open_cnt++;
+	if (inode != NULL) {
+		lock_acquire (&inode_table_lock);
+		inode_get (inode);
+		lock_release (&inode_table_lock);
+	}
 	return inode;
 }
 
@@ -152,20 +621,58 @@ inode_close (struct inode *inode) {
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+	/* Only the last opener has anything to do. */
+	lock_acquire (&inode_table_lock);
+	if (inode->open_cnt > 1) {
+		inode->open_cnt--;
+		lock_release (&inode_table_lock);
+		return;
+	}
+	lock_release (&inode_table_lock);
+
+#ifdef VM
+	/* Write back cached data, unless nobody can read it again.  The
+	 * inode stays open meanwhile, so that it cannot be freed under us. */
+	rwlock_acquire_write (&inode->rw);
+	page_cache_drop (inode, !inode->removed);
+	rwlock_release_write (&inode->rw);
+#endif
+
+	lock_acquire (&inode_table_lock);
+	if (--inode->open_cnt > 0) {
+		/* Opened again meanwhile: the last close to come does the rest. */
+		lock_release (&inode_table_lock);
+		return;
+	}
 
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
-		}
+	/* Deallocate blocks if removed. */
+	if (inode->removed) {
+		hash_delete (&inode_table, &inode->hash_elem);
+		lock_release (&inode_table_lock);
+
+		/* Whatever was cached of it as a directory must not outlive it:
+		 * its sector may hold another directory next. */
+		dcache_forget_dir (inode->sector);
+		journal_begin ();
+		free_map_release (inode->sector, 1);
+		inode_release_blocks (inode);
+		journal_end ();
+		inode_free (inode);
+		return;
+	}
 
-		free (inode); 
+	/* Keep it around in case it is opened again. */
+	struct inode *victim = NULL;
+	list_push_front (&closed_inodes, &inode->lru_elem);
+	if (++closed_cnt > CLOSED_INODES_MAX) {
+		victim = list_entry (list_pop_back (&closed_inodes), struct inode,
+				lru_elem);
+		hash_delete (&inode_table, &victim->hash_elem);
+		closed_cnt--;
 	}
+	lock_release (&inode_table_lock);
+	if (victim != NULL)
+		inode_free (victim);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -173,17 +680,111 @@ inode_close (struct inode *inode) {
 void
 inode_remove (struct inode *inode) {
 	ASSERT (inode != NULL);
+	lock_acquire (&inode_table_lock);
 	inode->removed = true;
+	lock_release (&inode_table_lock);
+}
+
+/* Marks INODE as holding file system metadata, such as a directory,
+ * whose data must be written through the journal. */
+void
+inode_mark_metadata (struct inode *inode) {
+	inode->metadata = true;
+}
+
+/* Takes the lock on the entries of INODE, a directory. */
+void
+inode_lock_dir (struct inode *inode) {
+	lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the lock taken with inode_lock_dir(). */
+void
+inode_unlock_dir (struct inode *inode) {
+	lock_release (&inode->dir_lock);
+}
+
+/* Takes the readers-writer lock on INODE's data for reading, as
+ * inode_read_at() does, for access to its data through the page cache. */
+void
+inode_lock_shared (struct inode *inode) {
+	rwlock_acquire_read (&inode->rw);
+}
+
+/* Releases the lock taken with inode_lock_shared(). */
+void
+inode_unlock_shared (struct inode *inode) {
+	rwlock_release_read (&inode->rw);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
  * than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+	off_t bytes_read;
+
+	rwlock_acquire_read (&inode->rw);
+#ifdef VM
+	if (page_cache_enabled && !inode->metadata)
+		bytes_read = page_cache_read (inode, buffer, size, offset);
+	else
+#endif
+		bytes_read = inode_read_direct (inode, buffer, size, offset);
+	rwlock_release_read (&inode->rw);
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * Returns the number of bytes actually written, which may be
+ * less than SIZE if an error occurs.  A write past the end of file
+ * extends the inode first; the gap up to OFFSET reads back as zeros.
+ * If the disk fills up, nothing is written past the old end. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	off_t bytes_written;
+	bool grow;
+
+	if (inode->deny_write_cnt || size <= 0)
+		return 0;
+
+	/* Files never shrink, so a write found to stay within the file does
+	 * so until it is done. */
+	grow = offset + size > inode_length (inode);
+	if (grow) {
+		rwlock_acquire_write (&inode->rw);
+		if (offset + size > inode->data.length) {
+			journal_begin ();
+			if (inode_extend (inode, offset + size))
+				inode->data.length = offset + size;
+			inode_save (inode);
+			journal_end ();
+		}
+	} else
+		rwlock_acquire_read (&inode->rw);
+
+#ifdef VM
+	if (page_cache_enabled && !inode->metadata)
+		bytes_written = page_cache_write (inode, buffer, size, offset);
+	else
+#endif
+		bytes_written = inode_write_direct (inode, buffer, size, offset);
+
+	if (grow)
+		rwlock_release_write (&inode->rw);
+	else
+		rwlock_release_read (&inode->rw);
+	return bytes_written;
+}
+
+/* Like inode_read_at(), but reads through the buffer cache only, past
+ * the page cache. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -200,45 +801,26 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
- * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+/* Like inode_write_at(), but writes through the buffer cache only, past
+ * the page cache, and whether or not writes are denied.  The data of a
+ * metadata inode go through the journal. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_direct (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
-
-	if (inode->deny_write_cnt)
-		return 0;
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
@@ -255,45 +837,44 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		if (inode->metadata)
+			journal_write (sector_idx, buffer + bytes_written, sector_ofs,
+					chunk_size);
+		else
+			buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_written;
 }
 
+/* Asks for the sectors that hold the SIZE bytes of INODE from OFFSET on
+ * to be read into the buffer cache in the background. */
+void
+inode_read_ahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end = offset + size;
+
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	for (offset = ROUND_DOWN (offset, DISK_SECTOR_SIZE); offset < end;
+			offset += DISK_SECTOR_SIZE)
+		buffer_cache_read_ahead (byte_to_sector (inode, offset));
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
 inode_deny_write (struct inode *inode) 
 {
+	lock_acquire (&inode_table_lock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	lock_release (&inode_table_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +882,11 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	lock_acquire (&inode_table_lock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	lock_release (&inode_table_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -0,0 +1,400 @@
+/* journal.c: Write-ahead journal of file system metadata.
+ *
+ * Metadata -- inodes, directories, the free map or the FAT -- are not
+ * written in place one sector at a time, in whatever order the buffer
+ * cache evicts them.  Instead, an operation that changes them, such as
+ * creating a file, runs between journal_begin() and journal_end(), and
+ * writes them with journal_write().  The sectors written join the running
+ * transaction, and stay in the buffer cache, which does not write them
+ * back, until the transaction is committed: then their new contents go to
+ * the journal, all of them in a single sequential run of sectors, and only
+ * after that may they reach their home locations.  A crash thus leaves
+ * each transaction either all on disk, by way of the journal, or not at
+ * all, and journal_init() redoes the committed ones.
+ *
+ * Transactions are batched: a transaction commits once it holds
+ * TX_COMMIT sectors and no operation is in progress, and otherwise when
+ * the flush daemon comes by.  Writing its sectors back to their homes,
+ * the checkpoint, is left to the buffer cache, until the journal fills
+ * up: then whatever the transactions in it changed is written back, and
+ * the journal starts over.  An operation that changes more than TX_MAX
+ * sectors, which the buffer cache could not all hold back at once, is
+ * split over several transactions.
+ *
+ * File data do not go through the journal: after a crash, a file may
+ * hold stale data where it was being written, but the file system's
+ * structures are consistent.
+ *
+ * Layout.  The journal takes the last JOURNAL_SECTORS sectors of the disk.
+ * The first holds a struct journal_super, which gives the sequence number
+ * of the first record in the rest of the journal, the log.  Each record
+ * is a struct journal_record followed by the new contents of the sectors
+ * it lists.  A record also lists revoked sectors: sectors in earlier
+ * records that were freed since, and that replaying those records must
+ * not overwrite, as they may hold file data by now. */
+
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Identify journal sectors. */
+#define SUPER_MAGIC 0x4a4e4c53
+#define RECORD_MAGIC 0x4a4e4c52
+
+/* Number of sectors of the log. */
+#define LOG_SECTORS (JOURNAL_SECTORS - 1)
+
+/* Most sectors in a transaction.  The buffer cache holds them all back
+ * until the commit, so this must be well below its size. */
+#define TX_MAX 32
+
+/* Number of sectors at which a transaction is committed as soon as no
+ * operation is in progress. */
+#define TX_COMMIT 16
+
+/* Number of sectors a record can list, and how many of them may be
+ * revoked ones. */
+#define RECORD_SLOTS 123
+#define REVOKE_MAX (RECORD_SLOTS - TX_MAX)
+
+/* First sector of the journal.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_super {
+	uint32_t magic;                 /* SUPER_MAGIC. */
+	uint32_t seq;                   /* Sequence number of the first record. */
+	uint32_t unused[126];           /* Not used. */
+};
+
+/* Header of a record.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_record {
+	uint32_t magic;                 /* RECORD_MAGIC. */
+	uint32_t seq;                   /* Sequence number. */
+	uint32_t block_cnt;             /* Number of sectors logged. */
+	uint32_t revoke_cnt;            /* Number of sectors revoked. */
+	uint32_t checksum;              /* Of the sectors logged. */
+	disk_sector_t sectors[RECORD_SLOTS]; /* Sectors logged, then revoked. */
+};
+
+static disk_sector_t start;           /* First sector of the journal. */
+static struct lock journal_lock;
+static int users;                     /* Operations in progress. */
+static uint32_t seq;                  /* Sequence number of the next record. */
+static size_t head;                   /* Where the next record goes in the
+                                         log. */
+static struct bitmap *logged;         /* Sectors in the log. */
+
+/* The running transaction. */
+static disk_sector_t tx_sectors[TX_MAX]; /* Sectors written. */
+static bool tx_revoked[TX_MAX];       /* Freed since? */
+static size_t tx_cnt;
+static disk_sector_t revokes[REVOKE_MAX]; /* Sectors in the log freed. */
+static size_t revoke_cnt;
+
+/* Staging area for commits, protected by JOURNAL_LOCK. */
+static struct journal_record record;
+static uint8_t images[TX_MAX][DISK_SECTOR_SIZE];
+
+/* Statistics. */
+static long long commit_cnt;          /* Transactions committed. */
+static long long logged_cnt;          /* Sectors written to the log. */
+static long long checkpoint_cnt;      /* Times the log was emptied. */
+
+static void replay (void);
+
+/* Returns the first sector of the journal. */
+disk_sector_t
+journal_region (void) {
+	return disk_size (filesys_disk) - JOURNAL_SECTORS;
+}
+
+/* Returns the disk sector of sector POS of the log. */
+static disk_sector_t
+log_sector (size_t pos) {
+	ASSERT (pos < LOG_SECTORS);
+	return start + 1 + pos;
+}
+
+/* Returns the checksum of the first CNT sectors of IMAGES. */
+static uint32_t
+checksum (size_t cnt) {
+	uint32_t sum = 0;
+	for (size_t i = 0; i < cnt; i++)
+		sum = sum * 31 + (uint32_t) hash_bytes (images[i], DISK_SECTOR_SIZE);
+	return sum;
+}
+
+/* Writes the journal's first sector, for a log whose first record will
+ * be number SEQ. */
+static void
+write_super (void) {
+	static struct journal_super super;
+
+	ASSERT (sizeof super == DISK_SECTOR_SIZE);
+	super.magic = SUPER_MAGIC;
+	super.seq = seq;
+	disk_write (filesys_disk, start, &super);
+}
+
+/* Initializes the journal, replaying it unless FORMAT is true. */
+void
+journal_init (bool format) {
+	ASSERT (sizeof record == DISK_SECTOR_SIZE);
+
+	start = journal_region ();
+	lock_init (&journal_lock);
+	logged = bitmap_create (disk_size (filesys_disk));
+	if (logged == NULL)
+		PANIC ("journal bitmap creation failed");
+
+	seq = 1;
+	if (!format)
+		replay ();
+	else {
+		/* Whatever an earlier file system left in the log must not pass
+		 * for a record of this one. */
+		static uint8_t zeros[DISK_SECTOR_SIZE];
+		disk_write (filesys_disk, log_sector (0), zeros);
+	}
+	head = 0;
+	write_super ();
+}
+
+/* Writes the sectors changed by the records in the log back to their
+ * homes, and empties the log.  JOURNAL_LOCK must be held. */
+static void
+checkpoint (void) {
+	size_t sector = 0;
+
+	while ((sector = bitmap_scan (logged, sector, 1, true)) != BITMAP_ERROR)
+		buffer_cache_checkpoint (sector++);
+	bitmap_set_all (logged, false);
+	head = 0;
+	revoke_cnt = 0;
+	write_super ();
+	checkpoint_cnt++;
+}
+
+/* Commits the running transaction.  JOURNAL_LOCK must be held. */
+static void
+commit (void) {
+	size_t n = 0;
+
+	if (tx_cnt == 0 && revoke_cnt == 0)
+		return;
+
+	for (size_t i = 0; i < tx_cnt; i++)
+		if (!tx_revoked[i])
+			n++;
+	if (head + 1 + n > LOG_SECTORS)
+		checkpoint ();
+
+	record.magic = RECORD_MAGIC;
+	record.seq = seq;
+	record.block_cnt = 0;
+	for (size_t i = 0; i < tx_cnt; i++)
+		if (!tx_revoked[i]) {
+			buffer_cache_read (tx_sectors[i], images[record.block_cnt], 0,
+					DISK_SECTOR_SIZE);
+			record.sectors[record.block_cnt++] = tx_sectors[i];
+		}
+	record.revoke_cnt = revoke_cnt;
+	memcpy (record.sectors + n, revokes, revoke_cnt * sizeof *revokes);
+	record.checksum = checksum (n);
+
+	/* The one sequential write. */
+	disk_write (filesys_disk, log_sector (head), &record);
+	for (size_t i = 0; i < n; i++)
+		disk_write (filesys_disk, log_sector (head + 1 + i), images[i]);
+
+	for (size_t i = 0; i < tx_cnt; i++) {
+		buffer_cache_commit (tx_sectors[i]);
+		if (!tx_revoked[i])
+			bitmap_mark (logged, tx_sectors[i]);
+	}
+	head += 1 + n;
+	seq++;
+	tx_cnt = revoke_cnt = 0;
+	commit_cnt++;
+	logged_cnt += n;
+}
+
+/* Starts an operation that changes metadata: the running transaction is
+ * not committed before the operation ends, unless it grows too large. */
+void
+journal_begin (void) {
+	lock_acquire (&journal_lock);
+	users++;
+	lock_release (&journal_lock);
+}
+
+/* Ends an operation started with journal_begin(). */
+void
+journal_end (void) {
+	lock_acquire (&journal_lock);
+	ASSERT (users > 0);
+	if (--users == 0 && tx_cnt >= TX_COMMIT)
+		commit ();
+	lock_release (&journal_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR, a metadata
+ * sector, as part of the running transaction. */
+void
+journal_write (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size) {
+	size_t i;
+
+	lock_acquire (&journal_lock);
+	for (i = 0; i < tx_cnt; i++)
+		if (tx_sectors[i] == sector)
+			break;
+	if (i == tx_cnt) {
+		if (tx_cnt == TX_MAX)
+			commit ();
+		i = tx_cnt++;
+		tx_sectors[i] = sector;
+	}
+	tx_revoked[i] = false;
+	buffer_cache_write_tx (sector, buffer, ofs, size);
+	lock_release (&journal_lock);
+}
+
+/* Notes that SECTOR was freed, so that whatever the journal holds of it
+ * is not replayed over what it may hold next. */
+void
+journal_revoke (disk_sector_t sector) {
+	lock_acquire (&journal_lock);
+	for (size_t i = 0; i < tx_cnt; i++)
+		if (tx_sectors[i] == sector)
+			tx_revoked[i] = true;
+	if (bitmap_test (logged, sector)) {
+		size_t i;
+
+		for (i = 0; i < revoke_cnt; i++)
+			if (revokes[i] == sector)
+				break;
+		if (i == revoke_cnt) {
+			/* Out of room for revocations: empty the log instead, which
+			 * makes them needless. */
+			if (revoke_cnt < REVOKE_MAX)
+				revokes[revoke_cnt++] = sector;
+			else
+				checkpoint ();
+		}
+	}
+	lock_release (&journal_lock);
+}
+
+/* Commits the running transaction, unless an operation is in
+ * progress. */
+void
+journal_commit (void) {
+	lock_acquire (&journal_lock);
+	if (users == 0)
+		commit ();
+	lock_release (&journal_lock);
+}
+
+/* Commits the running transaction and writes everything back, leaving
+ * the journal empty. */
+void
+journal_done (void) {
+	lock_acquire (&journal_lock);
+	commit ();
+	buffer_cache_flush ();
+	bitmap_set_all (logged, false);
+	head = 0;
+	revoke_cnt = 0;
+	write_super ();
+	lock_release (&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) {
+	printf ("Journal: %lld transactions, %lld sectors logged, "
+			"%lld checkpoints\n", commit_cnt, logged_cnt, checkpoint_cnt);
+}
+
+/* Reads the record at POS in the log, number NUMBER, into R, and the
+ * sectors it logs into IMAGES.  Returns false if there is no such
+ * record: the log ends before POS. */
+static bool
+read_record (size_t pos, uint32_t number, struct journal_record *r) {
+	if (pos >= LOG_SECTORS)
+		return false;
+	disk_read (filesys_disk, log_sector (pos), r);
+	if (r->magic != RECORD_MAGIC || r->seq != number
+			|| r->block_cnt > TX_MAX || r->revoke_cnt > REVOKE_MAX
+			|| pos + 1 + r->block_cnt > LOG_SECTORS)
+		return false;
+	for (size_t i = 0; i < r->block_cnt; i++) {
+		if (r->sectors[i] >= start)
+			return false;
+		disk_read (filesys_disk, log_sector (pos + 1 + i), images[i]);
+	}
+	return checksum (r->block_cnt) == r->checksum;
+}
+
+/* Returns true if SECTOR is revoked by one of the CNT records in
+ * RECORDS. */
+static bool
+revoked (disk_sector_t sector, const struct journal_record *records,
+		size_t cnt) {
+	for (size_t i = 0; i < cnt; i++) {
+		const struct journal_record *r = &records[i];
+		for (size_t j = 0; j < r->revoke_cnt; j++)
+			if (r->sectors[r->block_cnt + j] == sector)
+				return true;
+	}
+	return false;
+}
+
+/* Redoes the records in the log: writes the sectors they log to their
+ * homes, in order, but those revoked by a later record. */
+static void
+replay (void) {
+	static struct journal_super super;
+	struct journal_record *records;
+	size_t cnt = 0, pos = 0;
+
+	disk_read (filesys_disk, start, &super);
+	if (super.magic != SUPER_MAGIC)
+		return;
+	seq = super.seq;
+
+	/* Find the records, that is, those written in full. */
+	records = malloc (LOG_SECTORS * sizeof *records);
+	if (records == NULL)
+		PANIC ("journal replay failed");
+	while (read_record (pos, seq + cnt, &records[cnt])) {
+		pos += 1 + records[cnt].block_cnt;
+		cnt++;
+	}
+
+	/* Redo them. */
+	pos = 0;
+	for (size_t i = 0; i < cnt; i++) {
+		const struct journal_record *r = &records[i];
+
+		read_record (pos, r->seq, &record);
+		for (size_t j = 0; j < r->block_cnt; j++)
+			if (!revoked (r->sectors[j], r + 1, cnt - i - 1))
+				disk_write (filesys_disk, r->sectors[j], images[j]);
+		pos += 1 + r->block_cnt;
+	}
+	if (cnt > 0)
+		printf ("Journal: replayed %zu transactions.\n", cnt);
+
+	seq += cnt;
+	free (records);
+}
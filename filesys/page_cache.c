@@ -1,6 +1,42 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
+ *
+ * With VM, file data is cached a page at a time in user frames that sit in
+ * the frame table next to the frames of user pages.  Such a frame records
+ * the inode and offset whose data it holds (frame->cache_inode and
+ * frame->cache_ofs), and is indexed by them here.  inode_read_at() and
+ * inode_write_at() copy from and into these frames, and the pages of
+ * mmap()ed files are mapped straight onto them (see vm_map_cached()), so
+ * every process that maps a part of a file, and every read() and write() of
+ * it, see one and the same frame.
+ *
+ * Writes only mark a frame dirty.  The page_cache_workerd thread writes
+ * dirty frames back every PAGE_CACHE_FLUSH_TICKS; besides, the evictor
+ * writes back the frames it reclaims, and the last inode_close() of a file
+ * the rest of its frames.
+ *
+ * The index and the cache_dirty flags are protected by frame_lock.  Frames
+ * only join or leave the cache with page_cache_lock held as well, which
+ * keeps a page from being read in again while the evictor is still
+ * writing it back.  The lock is held just for the index lookup and insert,
+ * and across an eviction: reading a page in, copying data into or out of a
+ * frame and writing a frame back happen without it.  A frame in use is
+ * pinned, so the evictor leaves it alone, and reads and writes of a file's
+ * data hold the readers-writer lock of its inode, so that accesses to
+ * different files run in parallel. */
 
 #include "vm/vm.h"
+#include <round.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -15,36 +51,410 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+#ifdef VM
+/* Interval between two write-backs of the dirty frames. */
+#define PAGE_CACHE_FLUSH_TICKS TIMER_FREQ
+
+bool page_cache_enabled;
+struct lock page_cache_lock;
+
+/* Signaled, under FRAME_LOCK, when a frame has been read in or unpinned. */
+static struct condition cache_cond;
+
+/* Serializes page_cache_flush(), whose lists link frames by flush_elem. */
+static struct lock flush_lock;
+
+/* Frames of the page cache, keyed by inode and offset. */
+static struct hash cache_index;
+
+static void page_cache_kworkerd (void *aux);
+
+/* Returns a hash value for the cached page in frame F. */
+static uint64_t
+cache_hash (const struct hash_elem *f_, void *aux UNUSED) {
+	const struct frame *f = hash_entry (f_, struct frame, cache_elem);
+	return hash_bytes (&f->cache_inode, sizeof f->cache_inode)
+		^ hash_int (f->cache_ofs / PGSIZE);
+}
+
+/* Returns true if the cached page in frame A precedes the one in B. */
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, cache_elem);
+	const struct frame *b = hash_entry (b_, struct frame, cache_elem);
+	if (a->cache_inode != b->cache_inode)
+		return a->cache_inode < b->cache_inode;
+	return a->cache_ofs < b->cache_ofs;
+}
+
+/* Returns the frame that caches the page at OFFSET in INODE, or NULL.
+ * FRAME_LOCK must be held. */
+static struct frame *
+cache_lookup (struct inode *inode, off_t offset) {
+	struct frame f;
+	struct hash_elem *e;
+
+	f.cache_inode = inode;
+	f.cache_ofs = offset;
+	e = hash_find (&cache_index, &f.cache_elem);
+	return e != NULL ? hash_entry (e, struct frame, cache_elem) : NULL;
+}
+
+/* Returns the number of bytes of INODE in its page at OFFSET. */
+static off_t
+cache_bytes (struct inode *inode, off_t offset) {
+	off_t left = inode_length (inode) - offset;
+	return left < 0 ? 0 : left < PGSIZE ? left : PGSIZE;
+}
+#endif
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+#ifdef VM
+	hash_init (&cache_index, cache_hash, cache_less, NULL);
+	lock_init (&page_cache_lock);
+	cond_init (&cache_cond);
+	lock_init (&flush_lock);
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	page_cache_enabled = true;
+#endif
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
-
+	return true;
 }
 
+/* The page cache gives out no pages of its own: its frames are mapped
+ * straight into the VM_FILE pages of mmap()s.  The operations below only
+ * complete the page type. */
+
 /* Utilze the Swap in mechanism to implement readhead */
 static bool
-page_cache_readahead (struct page *page, void *kva) {
+page_cache_readahead (struct page *page UNUSED, void *kva UNUSED) {
+	return false;
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
 static bool
-page_cache_writeback (struct page *page) {
+page_cache_writeback (struct page *page UNUSED) {
+	return true;
 }
 
 /* Destory the page_cache. */
 static void
-page_cache_destroy (struct page *page) {
+page_cache_destroy (struct page *page UNUSED) {
 }
 
-/* Worker thread for page cache */
+#ifdef VM
+/* Worker thread for page cache: writes dirty frames back, forever. */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (PAGE_CACHE_FLUSH_TICKS);
+		page_cache_flush ();
+	}
+}
+
+/* Returns the frame that caches the page at OFFSET, which must be
+ * page-aligned, in INODE, reading the page into a frame from GET_FRAME if
+ * it is not cached yet.  The frame is returned pinned, to be released with
+ * page_cache_put().  Returns NULL if no frame could be had.  INODE's
+ * readers-writer lock must be held. */
+struct frame *
+page_cache_get (struct inode *inode, off_t offset,
+		struct frame *(*get_frame) (void)) {
+	struct frame *frame, *new = NULL;
+
+	ASSERT (offset % PGSIZE == 0);
+
+	for (;;) {
+		lock_acquire (&page_cache_lock);
+		lock_acquire (&frame_lock);
+		frame = cache_lookup (inode, offset);
+		if (frame != NULL || new != NULL)
+			break;
+		lock_release (&frame_lock);
+		lock_release (&page_cache_lock);
+
+		/* Getting a frame may evict one, which takes PAGE_CACHE_LOCK. */
+		new = get_frame ();
+		if (new == NULL)
+			return NULL;
+	}
+
+	if (frame != NULL) {
+		/* Cached already, or read in by somebody else meanwhile. */
+		frame->pin_cnt++;
+		lock_release (&page_cache_lock);
+		while (frame->cache_loading)
+			cond_wait (&cache_cond, &frame_lock);
+		lock_release (&frame_lock);
+		if (new != NULL) {
+			palloc_free_page (new->kva);
+			free (new);
+		}
+		return frame;
+	}
+
+	/* Enter NEW into the cache before reading it in, so that nobody else
+	 * reads the same page meanwhile. */
+	frame = new;
+	frame->cache_inode = inode;
+	frame->cache_ofs = offset;
+	frame->cache_dirty = false;
+	frame->cache_loading = true;
+	frame->pin_cnt++;
+	hash_insert (&cache_index, &frame->cache_elem);
+	vm_frame_track (frame);
+	lock_release (&frame_lock);
+	lock_release (&page_cache_lock);
+
+	off_t bytes = cache_bytes (inode, offset);
+	if (bytes > 0) {
+		inode_read_direct (inode, frame->kva, bytes, offset);
+		thread_current ()->vm_stats.disk_reads++;
+	}
+	memset (frame->kva + bytes, 0, PGSIZE - bytes);
+
+	lock_acquire (&frame_lock);
+	frame->cache_loading = false;
+	cond_broadcast (&cache_cond, &frame_lock);
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Drops a pin on FRAME.  FRAME_LOCK must be held. */
+static void
+cache_unpin (struct frame *frame) {
+	ASSERT (frame->pin_cnt > 0);
+	frame->pin_cnt--;
+	cond_broadcast (&cache_cond, &frame_lock);
+}
+
+/* Releases FRAME, obtained from page_cache_get(), marking it DIRTY if its
+ * contents were changed. */
+void
+page_cache_put (struct frame *frame, bool dirty) {
+	lock_acquire (&frame_lock);
+	if (dirty)
+		frame->cache_dirty = true;
+	frame->referenced = true;
+	cache_unpin (frame);
+	lock_release (&frame_lock);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET, through the
+ * page cache.  Returns the number of bytes read, which is short at end of
+ * file or if memory runs out.  INODE's readers-writer lock must be
+ * held. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+
+	while (size > 0) {
+		/* Page to read, starting byte offset within page. */
+		off_t page_ofs = ROUND_DOWN (offset, PGSIZE);
+		int in_page = offset - page_ofs;
+
+		/* Bytes left in inode, bytes left in page, lesser of the two. */
+		off_t inode_left = inode_length (inode) - offset;
+		int page_left = PGSIZE - in_page;
+		int min_left = inode_left < page_left ? inode_left : page_left;
+
+		/* Number of bytes to actually copy out of this page. */
+		int chunk_size = size < min_left ? size : min_left;
+		if (chunk_size <= 0)
+			break;
+
+		struct frame *frame = page_cache_get (inode, page_ofs, vm_get_frame);
+		if (frame == NULL)
+			break;
+		memcpy (buffer + bytes_read, frame->kva + in_page, chunk_size);
+		page_cache_put (frame, false);
+
+		/* Advance. */
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_read += chunk_size;
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET, through the
+ * page cache.  Returns the number of bytes written, which is short at end
+ * of file or if memory runs out.  The data reach the disk later.  INODE's
+ * readers-writer lock must be held. */
+off_t
+page_cache_write (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
+
+	while (size > 0) {
+		/* Page to write, starting byte offset within page. */
+		off_t page_ofs = ROUND_DOWN (offset, PGSIZE);
+		int in_page = offset - page_ofs;
+
+		/* Bytes left in inode, bytes left in page, lesser of the two. */
+		off_t inode_left = inode_length (inode) - offset;
+		int page_left = PGSIZE - in_page;
+		int min_left = inode_left < page_left ? inode_left : page_left;
+
+		/* Number of bytes to actually write into this page. */
+		int chunk_size = size < min_left ? size : min_left;
+		if (chunk_size <= 0)
+			break;
+
+		struct frame *frame = page_cache_get (inode, page_ofs, vm_get_frame);
+		if (frame == NULL)
+			break;
+		memcpy (frame->kva + in_page, buffer + bytes_written, chunk_size);
+		page_cache_put (frame, true);
+
+		/* Advance. */
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_written += chunk_size;
+	}
+	return bytes_written;
+}
+
+/* Moves the dirty bits of the pages mapping FRAME into FRAME and returns
+ * whether FRAME is dirty.  FRAME_LOCK must be held. */
+static bool
+cache_test_dirty (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+		if (pml4 != NULL && pml4_is_dirty (pml4, page->va)) {
+			pml4_set_dirty (pml4, page->va, false);
+			frame->cache_dirty = true;
+		}
+	}
+	return frame->cache_dirty;
+}
+
+/* Writes FRAME back to its file if it, or a page mapping it, is dirty.
+ * FRAME must be kept from being evicted: by being pinned, or by being out
+ * of the frame table.  Returns false if the write failed, leaving FRAME
+ * dirty. */
+bool
+page_cache_write_frame (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	bool dirty = cache_test_dirty (frame);
+	frame->cache_dirty = false;
+	lock_release (&frame_lock);
+
+	if (!dirty)
+		return true;
+
+	/* Writes into the frame from here on dirty it again.  The file never
+	 * shrinks, so the write stays within it without INODE's locks. */
+	off_t bytes = cache_bytes (frame->cache_inode, frame->cache_ofs);
+	if (inode_write_direct (frame->cache_inode, frame->kva, bytes,
+				frame->cache_ofs) == bytes)
+		return true;
+	lock_acquire (&frame_lock);
+	frame->cache_dirty = true;
+	lock_release (&frame_lock);
+	return false;
+}
+
+/* Takes FRAME, which no page maps any more, out of the page cache.
+ * FRAME_LOCK must be held, and FRAME kept from being looked up meanwhile:
+ * by PAGE_CACHE_LOCK, or by the readers-writer lock of its inode held for
+ * writing. */
+void
+page_cache_forget (struct frame *frame) {
+	ASSERT (frame->page_cnt == 0);
+
+	hash_delete (&cache_index, &frame->cache_elem);
+	frame->cache_inode = NULL;
+	frame->cache_dirty = false;
+}
+
+/* Drops the pages of INODE, which is being closed for the last time, from
+ * the page cache, writing back the dirty ones first if WRITEBACK.  INODE's
+ * readers-writer lock must be held for writing, so that nobody reads its
+ * pages in again meanwhile. */
+void
+page_cache_drop (struct inode *inode, bool writeback) {
+	if (!page_cache_enabled)
+		return;
+
+	for (off_t ofs = 0; ofs < inode_length (inode); ofs += PGSIZE) {
+		/* Pin the frame, so that the evictor leaves it to us. */
+		lock_acquire (&page_cache_lock);
+		lock_acquire (&frame_lock);
+		struct frame *frame = cache_lookup (inode, ofs);
+		if (frame != NULL)
+			frame->pin_cnt++;
+		lock_release (&frame_lock);
+		lock_release (&page_cache_lock);
+		if (frame == NULL)
+			continue;
+
+		if (writeback)
+			page_cache_write_frame (frame);
+
+		/* The flush daemon may still be writing it back. */
+		lock_acquire (&frame_lock);
+		while (frame->pin_cnt > 1)
+			cond_wait (&cache_cond, &frame_lock);
+		frame->pin_cnt--;
+		page_cache_forget (frame);
+		vm_frame_discard (frame);
+		lock_release (&frame_lock);
+	}
+}
+
+/* Writes every dirty frame of the page cache back to its file. */
+void
+page_cache_flush (void) {
+	struct hash_iterator i;
+	struct list dirty;
+
+	if (!page_cache_enabled)
+		return;
+
+	/* Pin the dirty frames, then write them back without the locks. */
+	list_init (&dirty);
+	lock_acquire (&flush_lock);
+	lock_acquire (&page_cache_lock);
+	lock_acquire (&frame_lock);
+	hash_first (&i, &cache_index);
+	while (hash_next (&i)) {
+		struct frame *frame = hash_entry (hash_cur (&i), struct frame,
+				cache_elem);
+		if (!frame->cache_loading && cache_test_dirty (frame)) {
+			frame->pin_cnt++;
+			list_push_back (&dirty, &frame->flush_elem);
+		}
+	}
+	lock_release (&frame_lock);
+	lock_release (&page_cache_lock);
+
+	while (!list_empty (&dirty)) {
+		struct frame *frame = list_entry (list_pop_front (&dirty),
+				struct frame, flush_elem);
+		page_cache_write_frame (frame);
+		lock_acquire (&frame_lock);
+		cache_unpin (frame);
+		lock_release (&frame_lock);
+	}
+	lock_release (&flush_lock);
 }
+#endif
@@ -0,0 +1,21 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+void buffer_cache_init (void);
+void buffer_cache_read (disk_sector_t sector, void *buffer, size_t ofs,
+		size_t size);
+void buffer_cache_write (disk_sector_t sector, const void *buffer,
+		size_t ofs, size_t size);
+void buffer_cache_write_tx (disk_sector_t sector, const void *buffer,
+		size_t ofs, size_t size);
+void buffer_cache_commit (disk_sector_t sector);
+void buffer_cache_checkpoint (disk_sector_t sector);
+void buffer_cache_read_ahead (disk_sector_t sector);
+void buffer_cache_flush (void);
+void buffer_cache_print_stats (void);
+
+#endif /* filesys/buffer_cache.h */
@@ -0,0 +1,14 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+void dcache_init (void);
+bool dcache_lookup (disk_sector_t dir, const char *name, bool *exists,
+		disk_sector_t *sector);
+void dcache_add (disk_sector_t dir, const char *name, disk_sector_t sector);
+void dcache_add_negative (disk_sector_t dir, const char *name);
+void dcache_forget_dir (disk_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -5,8 +5,13 @@
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#define ROOT_DIR_SECTOR (cluster_to_sector (ROOT_DIR_CLUSTER))
+#else
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#endif
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
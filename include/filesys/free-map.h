@@ -12,6 +12,8 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+size_t free_map_allocate_near (disk_sector_t hint, size_t cnt,
+		disk_sector_t *);
 void free_map_release (disk_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
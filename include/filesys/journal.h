@@ -0,0 +1,22 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Number of sectors at the end of the disk that hold the journal. */
+#define JOURNAL_SECTORS 128
+
+disk_sector_t journal_region (void);
+void journal_init (bool format);
+void journal_begin (void);
+void journal_end (void);
+void journal_write (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size);
+void journal_revoke (disk_sector_t sector);
+void journal_commit (void);
+void journal_done (void);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
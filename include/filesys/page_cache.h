@@ -1,12 +1,35 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
+#include "threads/synch.h"
 #include "vm/vm.h"
 
 struct page;
+struct frame;
+struct inode;
 enum vm_type;
 
 struct page_cache {};
 
-void page_cache_init (void);
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+
+#ifdef VM
+/* Set once the page cache is up: file data goes through it from then on. */
+extern bool page_cache_enabled;
+/* Held while looking up or adding a frame of the page cache, and while
+ * evicting one. */
+extern struct lock page_cache_lock;
+
+off_t page_cache_read (struct inode *inode, void *buffer, off_t size,
+		off_t offset);
+off_t page_cache_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset);
+struct frame *page_cache_get (struct inode *inode, off_t offset,
+		struct frame *(*get_frame) (void));
+void page_cache_put (struct frame *frame, bool dirty);
+bool page_cache_write_frame (struct frame *frame);
+void page_cache_forget (struct frame *frame);
+void page_cache_drop (struct inode *inode, bool writeback);
+void page_cache_flush (void);
+#endif
 #endif
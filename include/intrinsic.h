@@ -50,6 +50,27 @@ static __inline uint64_t rcr3(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0, %%cr4" : : "r" (val));
+}
+
+/* Executes CPUID for LEAF, storing the results in *A, *B, *C and *D. */
+__attribute__((always_inline))
+static __inline void cpuid(uint32_t leaf, uint32_t *a, uint32_t *b,
+		uint32_t *c, uint32_t *d) {
+	__asm __volatile("cpuid"
+			: "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+			: "a" (leaf), "c" (0));
+}
+
 __attribute__((always_inline))
 static __inline uint64_t rrax(void) {
 	uint64_t val;
@@ -36,6 +36,21 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Memory management, project 3 and later. */
+	SYS_MADVISE,                /* Give advice about use of memory. */
+	SYS_MINCORE,                /* Report which pages are resident. */
+	SYS_MLOCK,                  /* Lock pages in memory. */
+	SYS_MUNLOCK,                /* Unlock pages. */
+	SYS_BRK,                    /* Move the end of the heap. */
+	SYS_VMSTAT,                 /* Report paging statistics. */
 };
 
+/* Advice for madvise(). */
+#define MADV_NORMAL 0               /* No special treatment. */
+#define MADV_RANDOM 1               /* Expect random access: no readahead. */
+#define MADV_SEQUENTIAL 2           /* Expect sequential access. */
+#define MADV_WILLNEED 3             /* Will be needed soon: read it in. */
+#define MADV_DONTNEED 4             /* Not needed soon: page it out. */
+
 #endif /* lib/syscall-nr.h */
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <syscall-nr.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,6 +14,20 @@ typedef int pid_t;
 /* Map region identifier. */
 typedef int off_t;
 #define MAP_FAILED ((void *)NULL)
+#define MAP_ANONYMOUS (-1) /* FD of a zero-filled mapping of no file. */
+
+/* Paging statistics of a process, filled in by vmstat(). */
+struct vmstat {
+	size_t minor_faults;    /* Faults served without reading the disk. */
+	size_t major_faults;    /* Faults that had to read the disk. */
+	size_t cow_faults;      /* Shared frames copied on a write. */
+	size_t stack_faults;    /* Faults that grew the stack. */
+	size_t evictions;       /* Pages evicted from the process. */
+	size_t wss;             /* Working-set size, in pages (-vmstat). */
+	size_t wss_peak;        /* Largest working-set size seen. */
+	size_t stack_prefaults; /* Stack pages grown ahead of their fault,
+	                           each a stack fault avoided. */
+};
 
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
@@ -41,6 +57,13 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int mincore(void *addr, size_t length, unsigned char *vec);
+int mlock(const void *addr, size_t length);
+int munlock(const void *addr, size_t length);
+int brk(void *addr);
+void *sbrk(intptr_t increment);
+int vmstat(struct vmstat *st);
 
 /* Project 4 only. */
 bool chdir(const char *dir);
@@ -2,6 +2,7 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
@@ -12,9 +13,16 @@ uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void pml4_init_pcid (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_range (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_is_huge (uint64_t *pml4, const void *upage);
 void pml4_clear_page (uint64_t *pml4, void *upage);
+bool pml4_clear_range (uint64_t *pml4, void *upage, size_t cnt);
+bool pml4_protect_range (uint64_t *pml4, void *upage, size_t cnt, bool rw);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
@@ -41,5 +41,10 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=maps a 2 MB page (PDEs only). */
+
+/* Size of the page mapped by a PDE with PTE_PS set. */
+#define HUGE_PGSIZE (1UL << PDXSHIFT)
+#define HUGE_PGMASK (HUGE_PGSIZE - 1)
 
 #endif /* threads/pte.h */
@@ -41,6 +41,23 @@ void cond_wait(struct condition *, struct lock *);
 void cond_signal(struct condition *, struct lock *);
 void cond_broadcast(struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+{
+	struct lock lock;			 /* Protects the members below. */
+	struct condition readers_ok; /* Signaled when readers may enter. */
+	struct condition writer_ok;	 /* Signaled when a writer may enter. */
+	unsigned readers;			 /* Number of readers holding the lock. */
+	unsigned writers_waiting;	 /* Number of writers waiting for it. */
+	struct thread *writer;		 /* Writer holding the lock, if any. */
+};
+
+void rwlock_init(struct rwlock *);
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+
 bool cmp_condition(struct list_elem *a, struct list_elem *b, void *aux);
 bool cmp_donation(struct list_elem *a, struct list_elem *b, void *aux);
 void remove_donations(struct lock *lock);
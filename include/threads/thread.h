@@ -10,6 +10,7 @@
 #include "filesys/file.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/vmstat.h"
 #endif
 
 /* States in a thread's life cycle. */
@@ -147,6 +148,16 @@ struct thread
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	/* NOTE: [3.3] 시스템 콜 진입 시점의 유저 rsp (커널 모드 폴트의 스택 성장 판단용) */
+	uintptr_t user_rsp;
+	/* NOTE: [3.4] brk()로 관리하는 힙: 실행 파일의 마지막 세그먼트 바로 뒤에서 시작 */
+	uint8_t *heap_start;
+	uint8_t *heap_break;
+	/* NOTE: [3.3] 스택의 가장 낮은 페이지와 다음 성장 때 미리 할당할 페이지 수 */
+	uint8_t *stack_bottom;
+	size_t stack_chunk;
+	/* 페이지 폴트/워킹셋 통계 (vm/vmstat.c) */
+	struct vm_stats vm_stats;
 #endif
 
 	/* Owned by thread.c. */
@@ -166,6 +177,7 @@ void thread_tick(void);
 void thread_print_stats(void);
 
 typedef void thread_func(void *aux);
+typedef void thread_action_func(struct thread *t, void *aux);
 tid_t thread_create(const char *name, int priority, thread_func *, void *);
 
 void thread_block(void);
@@ -195,6 +207,7 @@ void thread_incr_recent_cpu(void);
 void calc_load_avg(void);
 void thread_all_calc_priority(void);
 void thread_all_calc_recent_cpu(void);
+void thread_foreach(thread_action_func *func, void *aux);
 
 // static cmp_priority(const struct list_elem *a_, const struct list_elem *b_, void *aux);
 
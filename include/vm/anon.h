@@ -1,13 +1,20 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include "vm/zswap.h"
 struct page;
 enum vm_type;
 
 struct anon_page {
+	size_t swap_slot;       /* Swap slot holding the page, or
+	                           BITMAP_ERROR if not on the swap disk. */
+	struct zswap_slot zswap;  /* Compressed copy kept in memory. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_discard (struct page *page);
+void *do_mmap_anon (void *addr, size_t length, bool writable);
+void *do_brk (void *addr);
 
 #endif
@@ -6,7 +6,31 @@
 struct page;
 enum vm_type;
 
+/* A run of consecutive user pages read from one file, created by a single
+ * mmap() call or by one PT_LOAD segment of an executable.  Every page that
+ * still comes from the file holds a reference; the last one closes FILE.
+ * The run also carries the readahead state for faults inside it.
+ * Anonymous mmap()s are runs without a file, kept so that munmap() can
+ * find all of their pages. */
+struct file_mapping {
+	struct file *file;      /* Private handle, owned by the mapping, or
+	                           NULL for an anonymous mapping. */
+	void *start;            /* First user page of the run. */
+	size_t page_cnt;        /* Number of pages in the run. */
+	int ref_cnt;            /* Pages (and creator) referring to us. */
+	void *ra_next;          /* Page that faults next if access is
+	                           sequential. */
+	size_t ra_window;       /* Current readahead window, in pages. */
+	int advice;             /* Access pattern given to madvise(), one
+	                           of MADV_NORMAL, MADV_RANDOM or
+	                           MADV_SEQUENTIAL. */
+};
+
+/* Where the contents of a file-backed page come from.  Also used as the
+ * AUX of lazily loaded pages, before they are initialized. */
 struct file_page {
+	off_t offset;           /* Offset of the page in the mapped file. */
+	size_t read_bytes;      /* Bytes read from the file; rest is zero. */
 };
 
 void vm_file_init (void);
@@ -14,4 +38,11 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+
+struct file_mapping *file_mapping_create (struct file *file, void *start,
+		size_t page_cnt);
+struct file_mapping *file_mapping_get (struct file_mapping *map);
+void file_mapping_put (struct file_mapping *map);
+off_t file_mapping_read (struct file_mapping *map, void *kva,
+		const struct file_page *fp);
 #endif
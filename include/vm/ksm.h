@@ -0,0 +1,15 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stddef.h>
+
+struct frame;
+
+/* Frames scanned per KSM_SLEEP_TICKS, set with -ksm; 0 disables merging. */
+extern size_t ksm_pages_to_scan;
+
+void ksm_init (void);
+void ksm_forget (struct frame *frame);
+void ksm_count_unmerge (void);
+void ksm_print_stats (void);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef VM_MADVISE_H
+#define VM_MADVISE_H
+#include <stddef.h>
+
+int vm_madvise (void *addr, size_t length, int advice);
+int vm_mincore (void *addr, size_t length, unsigned char *vec);
+int vm_mlock (void *addr, size_t length);
+int vm_munlock (void *addr, size_t length);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+#include "filesys/file.h"
+
+struct frame;
+
+/* Identifies a page of read-only program text. */
+struct text_key {
+	disk_sector_t inumber;  /* Inode of the executable. */
+	off_t offset;           /* Offset of the page in the file. */
+	size_t read_bytes;      /* Bytes read from the file; rest is zero. */
+};
+
+void text_init (void);
+struct frame *text_lookup (const struct text_key *key);
+bool text_insert (struct frame *frame, const struct text_key *key,
+		struct file *file);
+void text_forget (struct frame *frame);
+void text_reap (void);
+struct file *text_open (struct file *file);
+void text_close (struct file *file);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -33,9 +35,15 @@ enum vm_type {
 
 struct page_operations;
 struct thread;
+struct file_mapping;
+struct text_entry;
+struct inode;
 
 #define VM_TYPE(type) ((type) & 7)
 
+/* Limit on the size of the user stack. */
+#define STACK_LIMIT (1 << 20)
+
 /* The representation of "page".
  * This is kind of "parent class", which has four "child class"es, which are
  * uninit_page, file_page, anon_page, and page cache (project4).
@@ -46,6 +54,14 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct hash_elem spt_elem;   /* Element in the owner's SPT. */
+	struct thread *owner;        /* Thread whose page table maps VA. */
+	bool writable;               /* May the user write to this page? */
+	struct file_mapping *map;    /* File run this page is read from, or
+	                                NULL once it no longer comes from a
+	                                file. */
+	struct list_elem frame_elem; /* Element in the frame's page list. */
+	bool locked;                 /* mlock()ed: never evicted. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -63,6 +79,33 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+
+	/* Your implementation */
+	struct list_elem elem;       /* Element in the frame table. */
+	unsigned pin_cnt;            /* Number of pins; must not be evicted
+	                                while nonzero. */
+	bool evicting;               /* Being written out by the evictor. */
+	struct list pages;           /* Pages mapping this frame; PAGE is the
+	                                first of them. */
+	size_t page_cnt;             /* Number of PAGES.  Frames shared by
+	                                more than one page are mapped
+	                                read-only. */
+	struct hash_elem ksm_elem;   /* Element in the KSM index. */
+	uint64_t ksm_sum;            /* Checksum at the last KSM scan. */
+	bool ksm_indexed;            /* In the KSM index? */
+	struct text_entry *text;     /* Shared program text entry, or NULL. */
+	bool referenced;             /* Accessed bit taken over by the
+	                                working-set sampler. */
+	int64_t last_use;            /* Ticks when last seen accessed. */
+	struct inode *cache_inode;   /* File cached in this frame by the page
+	                                cache, or NULL.  Such frames stay
+	                                writable when shared and outlive the
+	                                pages that map them. */
+	off_t cache_ofs;             /* Offset of the cached page in the file. */
+	bool cache_dirty;            /* Newer than the file on disk. */
+	bool cache_loading;          /* Still being read from the file. */
+	struct hash_elem cache_elem; /* Element in the page cache index. */
+	struct list_elem flush_elem; /* Element in a page cache flush list. */
 };
 
 /* The function table for page operations.
@@ -85,6 +128,7 @@ struct page_operations {
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
+	struct hash pages;           /* Pages keyed by user virtual address. */
 };
 
 #include "threads/thread.h"
@@ -97,6 +141,21 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
+/* Protects the frame table and the frames in it, see vm.c. */
+extern struct lock frame_lock;
+struct frame *vm_frame_scan_next (void);
+struct frame *vm_get_frame (void);
+void vm_frame_track (struct frame *frame);
+void vm_frame_discard (struct frame *frame);
+bool vm_frame_protect (struct frame *frame, bool read_only);
+void vm_frame_merge (struct frame *dst, struct frame *src);
+void vm_sample_working_set (void);
+
+/* Free user frame watermarks of the reclaim daemon, in pages.  Zero
+ * selects a default based on the size of the user pool. */
+extern size_t vm_wm_low;
+extern size_t vm_wm_high;
+
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
@@ -105,8 +164,18 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
+bool vm_alloc_mapped_page (enum vm_type type, void *upage, bool writable,
+		vm_initializer *init, void *aux, struct file_mapping *map);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+void vm_free_frame (struct page *page);
+bool vm_pin_page (struct page *page, bool write);
+void vm_unpin_page (struct page *page);
+bool vm_lock_page (struct page *page);
+void vm_unlock_page (struct page *page);
+bool vm_prefetch_page (struct page *page);
+bool vm_page_out (struct page *page);
+bool vm_page_discard (struct page *page);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
@@ -0,0 +1,30 @@
+#ifndef VM_VMSTAT_H
+#define VM_VMSTAT_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct thread;
+
+/* Paging behaviour of one process, kept in its struct thread. */
+struct vm_stats {
+	size_t minor_faults;    /* Faults served without reading the disk. */
+	size_t major_faults;    /* Faults that had to read the disk. */
+	size_t cow_faults;      /* Shared frames copied on a write. */
+	size_t stack_faults;    /* Faults that grew the stack. */
+	size_t stack_prefaults; /* Stack pages grown ahead of their fault. */
+	size_t evictions;       /* Pages evicted from the process. */
+	size_t wss;             /* Pages used in the last sampling period. */
+	size_t wss_peak;        /* Largest WSS seen. */
+
+	size_t resident;        /* Pages resident right now. */
+	size_t disk_reads;      /* Pages read from disk on our behalf. */
+	size_t ws_scan;         /* Pages seen used by the sampling going on. */
+};
+
+/* Set with -vmstat: sample working sets and report at process exit. */
+extern bool vmstat_enabled;
+
+void vmstat_init (void);
+void vmstat_print (struct thread *t);
+
+#endif
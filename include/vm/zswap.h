@@ -0,0 +1,22 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Where a compressed page lives in the zswap arena. */
+struct zswap_slot {
+	size_t chunk;           /* First arena chunk, ZSWAP_ZERO for a page of
+	                           zeros, or BITMAP_ERROR if not stored. */
+	size_t size;            /* Compressed size, in bytes. */
+};
+
+/* Arena size in pages, set with -zswap; 0 disables compressed swap. */
+extern size_t zswap_pages;
+
+void zswap_init (void);
+bool zswap_store (const void *kva, struct zswap_slot *slot);
+bool zswap_load (struct zswap_slot *slot, void *kva);
+void zswap_free (struct zswap_slot *slot);
+void zswap_print_stats (void);
+
+#endif
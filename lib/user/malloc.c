@@ -0,0 +1,205 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* The malloc() of user programs, on top of sbrk() and anonymous
+   mmap().
+
+   Like the kernel's threads/malloc.c, each request is rounded up
+   to a power of 2, its size class, and served from the free list
+   of that class.  When the list is empty, a page called an
+   "arena" is taken from the heap with sbrk() and divided into
+   blocks of the class, all of which go on the free list.
+
+   Freed blocks go back on the free list of their class.  Arenas
+   stay with their class for good: the heap only ever grows.
+
+   Requests bigger than 2 kB get pages of their own from an
+   anonymous mmap(), with the size of the allocation recorded in
+   an arena header at its start, and free() unmaps them again. */
+
+/* Size of a page. */
+#define PAGE_SIZE 4096
+
+/* Smallest and largest block sizes, and the number of classes. */
+#define MIN_BLOCK 16
+#define MAX_BLOCK (PAGE_SIZE / 2)
+#define CLASS_CNT 8
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena {
+	unsigned magic;             /* Always set to ARENA_MAGIC. */
+	size_t block_size;          /* Block size, 0 for a big block. */
+	size_t page_cnt;            /* Pages in a big block. */
+};
+
+/* Free block. */
+struct block {
+	struct block *next;         /* Next block in the free list. */
+};
+
+/* Free blocks of each size class, MIN_BLOCK << I bytes for class I. */
+static struct block *free_lists[CLASS_CNT];
+
+/* Returns the size class of a SIZE-byte request, which must be at most
+   MAX_BLOCK. */
+static size_t
+size_class (size_t size) {
+	size_t class = 0;
+
+	while ((size_t) MIN_BLOCK << class < size)
+		class++;
+	return class;
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (void *b) {
+	struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+	ASSERT (a->magic == ARENA_MAGIC);
+	return a;
+}
+
+/* Takes a new page-aligned arena for CLASS from the heap and puts its
+   blocks on the free list.  Returns false if the heap cannot grow. */
+static bool
+grow_class (size_t class) {
+	size_t block_size = (size_t) MIN_BLOCK << class;
+	char *top = sbrk (0);
+
+	/* Keep arenas page-aligned, so that a block finds its arena. */
+	char *end = (char *) ROUND_UP ((uintptr_t) top + PAGE_SIZE, PAGE_SIZE);
+	if (sbrk (end - top) == (void *) -1)
+		return false;
+
+	struct arena *a = (struct arena *) (end - PAGE_SIZE);
+	a->magic = ARENA_MAGIC;
+	a->block_size = block_size;
+	a->page_cnt = 1;
+
+	/* Keep blocks 16-byte aligned, as the ABI expects of malloc(). */
+	char *b = (char *) a + ROUND_UP (sizeof *a, MIN_BLOCK);
+	for (; b + block_size <= end; b += block_size) {
+		struct block *blk = (struct block *) b;
+		blk->next = free_lists[class];
+		free_lists[class] = blk;
+	}
+	return true;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) {
+	/* A null pointer satisfies a request for 0 bytes. */
+	if (size == 0)
+		return NULL;
+
+	if (size > MAX_BLOCK) {
+		/* Too big for any class: map enough pages to hold SIZE
+		   plus an arena. */
+		size_t page_cnt = DIV_ROUND_UP (size + sizeof (struct arena),
+				PAGE_SIZE);
+		struct arena *a = mmap (NULL, page_cnt * PAGE_SIZE, true,
+				MAP_ANONYMOUS, 0);
+		if (a == MAP_FAILED)
+			return NULL;
+
+		a->magic = ARENA_MAGIC;
+		a->block_size = 0;
+		a->page_cnt = page_cnt;
+		return a + 1;
+	}
+
+	size_t class = size_class (size);
+	if (free_lists[class] == NULL && !grow_class (class))
+		return NULL;
+
+	struct block *b = free_lists[class];
+	free_lists[class] = b->next;
+	return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) {
+	void *p;
+	size_t size;
+
+	/* Calculate block size and make sure it fits in size_t. */
+	size = a * b;
+	if (size < a || size < b)
+		return NULL;
+
+	/* Allocate and zero memory. */
+	p = malloc (size);
+	if (p != NULL)
+		memset (p, 0, size);
+
+	return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block) {
+	struct arena *a = block_to_arena (block);
+
+	return a->block_size != 0 ? a->block_size
+		: PAGE_SIZE * a->page_cnt - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) {
+	if (new_size == 0) {
+		free (old_block);
+		return NULL;
+	} else {
+		void *new_block = malloc (new_size);
+		if (old_block != NULL && new_block != NULL) {
+			size_t old_size = block_size (old_block);
+			size_t min_size = new_size < old_size ? new_size : old_size;
+			memcpy (new_block, old_block, min_size);
+			free (old_block);
+		}
+		return new_block;
+	}
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) {
+	if (p == NULL)
+		return;
+
+	struct arena *a = block_to_arena (p);
+	if (a->block_size == 0) {
+		/* It's a big block.  Unmap its pages. */
+		munmap (a);
+		return;
+	}
+
+#ifndef NDEBUG
+	/* Clear the block to help detect use-after-free bugs. */
+	memset (p, 0xcc, a->block_size);
+#endif
+
+	struct block *b = p;
+	size_t class = size_class (a->block_size);
+	b->next = free_lists[class];
+	free_lists[class] = b;
+}
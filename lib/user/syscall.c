@@ -155,6 +155,45 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+mincore (void *addr, size_t length, unsigned char *vec) {
+	return syscall3 (SYS_MINCORE, addr, length, vec);
+}
+
+int
+mlock (const void *addr, size_t length) {
+	return syscall2 (SYS_MLOCK, addr, length);
+}
+
+int
+munlock (const void *addr, size_t length) {
+	return syscall2 (SYS_MUNLOCK, addr, length);
+}
+
+int
+brk (void *addr) {
+	return (void *) syscall1 (SYS_BRK, addr) == addr ? 0 : -1;
+}
+
+int
+vmstat (struct vmstat *st) {
+	return syscall1 (SYS_VMSTAT, st);
+}
+
+void *
+sbrk (intptr_t increment) {
+	char *old = (char *) syscall1 (SYS_BRK, NULL);
+	if (increment == 0)
+		return old;
+	return (void *) syscall1 (SYS_BRK, old + increment) == old + increment
+		? old : (void *) -1;
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -0,0 +1,46 @@
+/* Grows the heap with sbrk(), checks that the new memory is
+   zero-filled and usable, then shrinks it with brk() and grows it
+   again. */
+
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  char *start = sbrk (0);
+  char *regrown;
+  size_t i;
+
+  CHECK (sbrk (3 * PAGE_SIZE) == start, "sbrk 3 pages");
+  CHECK (sbrk (0) == start + 3 * PAGE_SIZE, "break moved up 3 pages");
+  for (i = 0; i < 3 * PAGE_SIZE; i++)
+    if (start[i] != 0)
+      fail ("byte %zu of new heap is %d, not zero", i, start[i]);
+  memset (start, 'a', 3 * PAGE_SIZE);
+  msg ("new heap is zero-filled and writable");
+
+  CHECK (brk (start + PAGE_SIZE) == 0, "brk shrinks heap to 1 page");
+  CHECK (sbrk (0) == start + PAGE_SIZE, "break moved down 2 pages");
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (start[i] != 'a')
+      fail ("byte %zu of kept heap changed", i);
+  msg ("kept heap is intact");
+
+  /* The pages given back come back zero-filled. */
+  CHECK (sbrk (2 * PAGE_SIZE) == start + PAGE_SIZE, "sbrk regrows heap");
+  regrown = (char *) ROUND_UP ((uintptr_t) start + PAGE_SIZE, PAGE_SIZE);
+  for (; regrown < start + 3 * PAGE_SIZE; regrown++)
+    if (*regrown != 0)
+      fail ("regrown heap at %p is %d, not zero", regrown, *regrown);
+  msg ("regrown heap is zero-filled");
+
+  CHECK (brk ((void *) 0x8004000000) == -1, "brk into the kernel fails");
+  CHECK (sbrk (0) == start + 3 * PAGE_SIZE, "break did not move");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(brk-grow) begin
+(brk-grow) sbrk 3 pages
+(brk-grow) break moved up 3 pages
+(brk-grow) new heap is zero-filled and writable
+(brk-grow) brk shrinks heap to 1 page
+(brk-grow) break moved down 2 pages
+(brk-grow) kept heap is intact
+(brk-grow) sbrk regrows heap
+(brk-grow) regrown heap is zero-filled
+(brk-grow) brk into the kernel fails
+(brk-grow) break did not move
+(brk-grow) end
+brk-grow: exit(0)
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Grows the heap, shrinks it back with brk(), then touches memory
+   that is no longer part of the heap.  The process must be
+   terminated with -1 exit code. */
+
+#include <round.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  char *start = sbrk (0);
+  char *gone = (char *) ROUND_UP ((uintptr_t) start, PAGE_SIZE) + PAGE_SIZE;
+
+  CHECK (sbrk (3 * PAGE_SIZE) == start, "sbrk 3 pages");
+  *gone = 'a';
+  CHECK (brk (start) == 0, "brk shrinks heap back");
+  msg ("read freed heap");
+  fail ("freed heap is readable (%d)", *gone);
+}
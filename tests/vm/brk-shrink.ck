@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(brk-shrink) begin
+(brk-shrink) sbrk 3 pages
+(brk-shrink) brk shrinks heap back
+(brk-shrink) read freed heap
+brk-shrink: exit(-1)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Passes misaligned, unmapped and kernel addresses, and bad advice, to
+   madvise(), mincore(), mlock() and munlock(), which must all fail
+   with -1 without killing the process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  void *kernel = (void *) 0x8004000000;
+  unsigned char vec[3];
+  char *buf = ACTUAL;
+  int handle;
+
+  CHECK (create ("data", 2 * PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (mmap (buf, 2 * PAGE_SIZE, 1, handle, 0) != MAP_FAILED,
+         "mmap \"data\"");
+
+  CHECK (madvise (buf + 1, PAGE_SIZE, MADV_WILLNEED) == -1,
+         "madvise misaligned address");
+  CHECK (mincore (buf + 1, PAGE_SIZE, vec) == -1,
+         "mincore misaligned address");
+  CHECK (mlock (buf + 1, PAGE_SIZE) == -1, "mlock misaligned address");
+  CHECK (munlock (buf + 1, PAGE_SIZE) == -1, "munlock misaligned address");
+
+  CHECK (madvise (buf, 3 * PAGE_SIZE, MADV_WILLNEED) == -1,
+         "madvise past the end of the mapping");
+  CHECK (mincore (buf, 3 * PAGE_SIZE, vec) == -1,
+         "mincore past the end of the mapping");
+  CHECK (mlock (NULL, PAGE_SIZE) == -1, "mlock null address");
+  CHECK (munlock (kernel, PAGE_SIZE) == -1, "munlock kernel address");
+  CHECK (mincore (kernel, PAGE_SIZE, vec) == -1, "mincore kernel address");
+
+  CHECK (madvise (buf, PAGE_SIZE, -1) == -1, "madvise bad advice");
+  CHECK (madvise (buf, PAGE_SIZE, 42) == -1, "madvise bad advice 2");
+}
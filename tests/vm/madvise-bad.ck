@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(madvise-bad) begin
+(madvise-bad) create "data"
+(madvise-bad) open "data"
+(madvise-bad) mmap "data"
+(madvise-bad) madvise misaligned address
+(madvise-bad) mincore misaligned address
+(madvise-bad) mlock misaligned address
+(madvise-bad) munlock misaligned address
+(madvise-bad) madvise past the end of the mapping
+(madvise-bad) mincore past the end of the mapping
+(madvise-bad) mlock null address
+(madvise-bad) munlock kernel address
+(madvise-bad) mincore kernel address
+(madvise-bad) madvise bad advice
+(madvise-bad) madvise bad advice 2
+(madvise-bad) end
+madvise-bad: exit(0)
+EOF
+pass;
@@ -0,0 +1,36 @@
+/* Fills anonymous memory, drops it with madvise(MADV_DONTNEED), and
+   checks that the pages are gone and read back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 2
+
+void
+test_main (void)
+{
+  unsigned char vec[PAGE_CNT];
+  char *buf;
+  size_t i;
+
+  CHECK ((buf = mmap (NULL, PAGE_CNT * PAGE_SIZE, 1, MAP_ANONYMOUS, 0))
+         != MAP_FAILED, "mmap anonymous memory");
+  memset (buf, 'x', PAGE_CNT * PAGE_SIZE);
+  CHECK (madvise (buf, PAGE_CNT * PAGE_SIZE, MADV_DONTNEED) == 0,
+         "madvise MADV_DONTNEED");
+
+  CHECK (mincore (buf, PAGE_CNT * PAGE_SIZE, vec) == 0, "mincore");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (vec[i] != 0)
+      fail ("page %zu still resident", i);
+  for (i = 0; i < PAGE_CNT * PAGE_SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d, not zero", i, buf[i]);
+  msg ("dropped pages read back as zeros");
+
+  buf[0] = 'y';
+  CHECK (buf[0] == 'y', "write after MADV_DONTNEED");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(madvise-dontneed-anon) begin
+(madvise-dontneed-anon) mmap anonymous memory
+(madvise-dontneed-anon) madvise MADV_DONTNEED
+(madvise-dontneed-anon) mincore
+(madvise-dontneed-anon) dropped pages read back as zeros
+(madvise-dontneed-anon) write after MADV_DONTNEED
+(madvise-dontneed-anon) end
+madvise-dontneed-anon: exit(0)
+EOF
+pass;
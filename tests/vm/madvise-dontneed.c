@@ -0,0 +1,45 @@
+/* Writes to a file through a mapping, drops the pages with
+   madvise(MADV_DONTNEED), and checks that they are no longer resident
+   and that what was written reached the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+#define PAGE_CNT 2
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  unsigned char vec[PAGE_CNT];
+  int handle;
+  size_t i;
+
+  CHECK (create ("data", PAGE_CNT * PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (mmap (ACTUAL, PAGE_CNT * PAGE_SIZE, 1, handle, 0) != MAP_FAILED,
+         "mmap \"data\"");
+  memset (ACTUAL, 'x', PAGE_CNT * PAGE_SIZE);
+  CHECK (madvise (ACTUAL, PAGE_CNT * PAGE_SIZE, MADV_DONTNEED) == 0,
+         "madvise MADV_DONTNEED");
+
+  CHECK (mincore (ACTUAL, PAGE_CNT * PAGE_SIZE, vec) == 0, "mincore");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (vec[i] != 0)
+      fail ("page %zu still resident", i);
+
+  CHECK (read (handle, buf, sizeof buf) == (int) sizeof buf,
+         "read \"data\"");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'x')
+      fail ("byte %zu of the file is %d, not 'x'", i, buf[i]);
+  for (i = 0; i < PAGE_CNT * PAGE_SIZE; i++)
+    if (ACTUAL[i] != 'x')
+      fail ("byte %zu of the mapping is %d, not 'x'", i, ACTUAL[i]);
+  msg ("dropped pages were written back");
+}
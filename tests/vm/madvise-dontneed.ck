@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(madvise-dontneed) begin
+(madvise-dontneed) create "data"
+(madvise-dontneed) open "data"
+(madvise-dontneed) mmap "data"
+(madvise-dontneed) madvise MADV_DONTNEED
+(madvise-dontneed) mincore
+(madvise-dontneed) read "data"
+(madvise-dontneed) dropped pages were written back
+(madvise-dontneed) end
+madvise-dontneed: exit(0)
+EOF
+pass;
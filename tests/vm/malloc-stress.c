@@ -0,0 +1,87 @@
+/* Runs a long random sequence of malloc(), realloc() and free()
+   calls, over block sizes that come from the heap as well as from
+   anonymous mmap(), and checks that no block is ever clobbered. */
+
+#include <malloc.h>
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SLOT_CNT 128
+#define ROUND_CNT 4000
+#define MAX_SIZE (3 * 4096)
+
+/* A live block and the byte it is filled with. */
+struct slot
+  {
+    unsigned char *p;
+    size_t size;
+    unsigned char fill;
+  };
+
+static struct slot slots[SLOT_CNT];
+
+/* Fails unless the block in S still holds its fill byte. */
+static void
+check_slot (const struct slot *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->size; i++)
+    if (s->p[i] != s->fill)
+      fail ("block %p of %zu bytes clobbered at byte %zu",
+            s->p, s->size, i);
+}
+
+void
+test_main (void)
+{
+  int round;
+  size_t i;
+
+  random_init (0);
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      struct slot *s = &slots[random_ulong () % SLOT_CNT];
+      size_t size = random_ulong () % MAX_SIZE + 1;
+
+      if (round % 1000 == 0)
+        msg ("round %d", round);
+
+      if (s->p == NULL)
+        {
+          s->p = malloc (size);
+          if (s->p == NULL)
+            fail ("malloc (%zu) failed", size);
+        }
+      else
+        {
+          check_slot (s);
+          if (random_ulong () % 2)
+            {
+              free (s->p);
+              s->p = NULL;
+              continue;
+            }
+          s->p = realloc (s->p, size);
+          if (s->p == NULL)
+            fail ("realloc (%zu) failed", size);
+          if (size < s->size)
+            s->size = size;
+          check_slot (s);
+        }
+      s->size = size;
+      s->fill = round;
+      memset (s->p, s->fill, s->size);
+    }
+
+  for (i = 0; i < SLOT_CNT; i++)
+    if (slots[i].p != NULL)
+      {
+        check_slot (&slots[i]);
+        free (slots[i].p);
+      }
+  msg ("all blocks intact");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-stress) begin
+(malloc-stress) round 0
+(malloc-stress) round 1000
+(malloc-stress) round 2000
+(malloc-stress) round 3000
+(malloc-stress) all blocks intact
+(malloc-stress) end
+malloc-stress: exit(0)
+EOF
+pass;
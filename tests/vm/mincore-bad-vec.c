@@ -0,0 +1,22 @@
+/* Passes a kernel address as the result vector of mincore().  The
+   process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK (create ("data", PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (mmap (ACTUAL, PAGE_SIZE, 1, handle, 0) != MAP_FAILED,
+         "mmap \"data\"");
+  mincore (ACTUAL, PAGE_SIZE, (unsigned char *) 0x8004000000);
+  fail ("should have exited with -1");
+}
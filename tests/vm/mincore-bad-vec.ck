@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mincore-bad-vec) begin
+(mincore-bad-vec) create "data"
+(mincore-bad-vec) open "data"
+(mincore-bad-vec) mmap "data"
+mincore-bad-vec: exit(-1)
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Maps a file and checks that mincore() reports its pages as
+   resident only once they have been touched. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+#define PAGE_CNT 4
+
+void
+test_main (void)
+{
+  unsigned char vec[PAGE_CNT];
+  int handle;
+  int i;
+
+  CHECK (create ("data", PAGE_CNT * PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (mmap (ACTUAL, PAGE_CNT * PAGE_SIZE, 1, handle, 0) != MAP_FAILED,
+         "mmap \"data\"");
+
+  /* Without fault-around, a fault only brings in its own page. */
+  CHECK (madvise (ACTUAL, PAGE_CNT * PAGE_SIZE, MADV_RANDOM) == 0,
+         "madvise MADV_RANDOM");
+  CHECK (mincore (ACTUAL, PAGE_CNT * PAGE_SIZE, vec) == 0,
+         "mincore before touching");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (vec[i] != 0)
+      fail ("page %d resident before it was touched", i);
+
+  ACTUAL[0] = 1;
+  ACTUAL[2 * PAGE_SIZE] = 1;
+  CHECK (mincore (ACTUAL, PAGE_CNT * PAGE_SIZE, vec) == 0,
+         "mincore after touching pages 0 and 2");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (vec[i] != (i % 2 == 0))
+      fail ("page %d: mincore says %d", i, vec[i]);
+  msg ("only the touched pages are resident");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mincore-touch) begin
+(mincore-touch) create "data"
+(mincore-touch) open "data"
+(mincore-touch) mmap "data"
+(mincore-touch) madvise MADV_RANDOM
+(mincore-touch) mincore before touching
+(mincore-touch) mincore after touching pages 0 and 2
+(mincore-touch) only the touched pages are resident
+(mincore-touch) end
+mincore-touch: exit(0)
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Locks a page of a mapped file, then writes over more memory than
+   Pintos has (10 MB) to force eviction.  The locked page must stay
+   resident and keep its contents throughout. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (20 * ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+static char big_chunks[CHUNK_SIZE];
+
+void
+test_main (void)
+{
+  unsigned char vec;
+  int handle;
+  size_t i;
+
+  CHECK (create ("data", PAGE_SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (mmap (ACTUAL, PAGE_SIZE, 1, handle, 0) != MAP_FAILED,
+         "mmap \"data\"");
+  for (i = 0; i < PAGE_SIZE; i++)
+    ACTUAL[i] = (char) (i * 7);
+  CHECK (mlock (ACTUAL, PAGE_SIZE) == 0, "mlock page");
+
+  msg ("write sparsely over %d MB", CHUNK_SIZE / ONE_MB);
+  for (i = 0; i < PAGE_COUNT; i++)
+    big_chunks[i * PAGE_SIZE] = (char) i;
+
+  CHECK (mincore (ACTUAL, PAGE_SIZE, &vec) == 0, "mincore locked page");
+  if (vec != 1)
+    fail ("locked page was evicted");
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (ACTUAL[i] != (char) (i * 7))
+      fail ("byte %zu of locked page changed", i);
+  msg ("locked page stayed resident and intact");
+  CHECK (munlock (ACTUAL, PAGE_SIZE) == 0, "munlock page");
+}
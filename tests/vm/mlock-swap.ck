@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mlock-swap) begin
+(mlock-swap) create "data"
+(mlock-swap) open "data"
+(mlock-swap) mmap "data"
+(mlock-swap) mlock page
+(mlock-swap) write sparsely over 20 MB
+(mlock-swap) mincore locked page
+(mlock-swap) locked page stayed resident and intact
+(mlock-swap) munlock page
+(mlock-swap) end
+mlock-swap: exit(0)
+EOF
+pass;
@@ -0,0 +1,55 @@
+/* Maps anonymous memory, checks that it is zero-filled, and forks.
+   Parent and child each see their own copy: a write by the child
+   does not show up in the parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define MAP_SIZE (2 * PAGE_SIZE)
+
+/* Fails unless all of BUF is C. */
+static void
+check_fill (const char *buf, char c, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < MAP_SIZE; i++)
+    if (buf[i] != c)
+      fail ("%s: byte %zu is %d, not %d", who, i, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  char *buf;
+  pid_t pid;
+
+  CHECK ((buf = mmap (NULL, MAP_SIZE, 1, MAP_ANONYMOUS, 0)) != MAP_FAILED,
+         "mmap anonymous memory");
+  check_fill (buf, 0, "parent");
+  msg ("anonymous memory is zero-filled");
+  memset (buf, 'p', MAP_SIZE);
+
+  if ((pid = fork ("child")) == 0)
+    {
+      check_fill (buf, 'p', "child");
+      memset (buf, 'c', MAP_SIZE);
+      check_fill (buf, 'c', "child");
+      msg ("child wrote its copy");
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork failed");
+  msg ("child exit status is %d", wait (pid));
+  check_fill (buf, 'p', "parent");
+  msg ("parent copy is unchanged");
+
+  munmap (buf);
+  CHECK ((buf = mmap (NULL, MAP_SIZE, 1, MAP_ANONYMOUS, 0)) != MAP_FAILED,
+         "mmap anonymous memory again");
+  check_fill (buf, 0, "parent");
+  msg ("new mapping is zero-filled");
+}
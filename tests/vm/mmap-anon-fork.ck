@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mmap-anon-fork) begin
+(mmap-anon-fork) mmap anonymous memory
+(mmap-anon-fork) anonymous memory is zero-filled
+(mmap-anon-fork) child wrote its copy
+child: exit(0)
+(mmap-anon-fork) child exit status is 0
+(mmap-anon-fork) parent copy is unchanged
+(mmap-anon-fork) mmap anonymous memory again
+(mmap-anon-fork) new mapping is zero-filled
+(mmap-anon-fork) end
+mmap-anon-fork: exit(0)
+EOF
+pass;
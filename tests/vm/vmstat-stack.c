@@ -0,0 +1,48 @@
+/* Grows the stack by a large frame and checks that vmstat() counts
+   the growth: at least one stack fault, and the pages of the frame
+   either faulted in or grown ahead of use. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define FRAME_SIZE (32 * PAGE_SIZE)
+
+/* Returns the number of stack pages that ST counts as grown. */
+static size_t
+stack_pages (const struct vmstat *st)
+{
+  return st->stack_faults + st->stack_prefaults;
+}
+
+/* Stores into AFTER the statistics read from the bottom of a new
+   FRAME_SIZE stack frame. */
+static void NO_INLINE
+vmstat_deep (struct vmstat *after)
+{
+  char buf[FRAME_SIZE];
+  struct vmstat *st = (struct vmstat *) buf;
+
+  /* Nothing may touch the new frame before this call. */
+  if (vmstat (st) != 0)
+    fail ("vmstat into a new stack frame failed");
+  *after = *st;
+}
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+
+  CHECK (vmstat (&before) == 0, "vmstat before growing the stack");
+  vmstat_deep (&after);
+
+  if (after.stack_faults <= before.stack_faults)
+    fail ("stack faults did not rise: %zu, then %zu",
+          before.stack_faults, after.stack_faults);
+  if (stack_pages (&after) - stack_pages (&before) < FRAME_SIZE / PAGE_SIZE / 2)
+    fail ("stack grew by only %zu pages",
+          stack_pages (&after) - stack_pages (&before));
+  msg ("stack growth is counted");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vmstat-stack) begin
+(vmstat-stack) vmstat before growing the stack
+(vmstat-stack) stack growth is counted
+(vmstat-stack) end
+vmstat-stack: exit(0)
+EOF
+pass;
@@ -31,11 +31,16 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/ksm.h"
+#include "vm/zswap.h"
+#include "vm/vmstat.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -165,6 +170,7 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_init_pcid ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -226,6 +232,18 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-wm-low"))
+			vm_wm_low = atoi (value);
+		else if (!strcmp (name, "-wm-high"))
+			vm_wm_high = atoi (value);
+		else if (!strcmp (name, "-zswap"))
+			zswap_pages = atoi (value);
+		else if (!strcmp (name, "-ksm"))
+			ksm_pages_to_scan = atoi (value);
+		else if (!strcmp (name, "-vmstat"))
+			vmstat_enabled = true;
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -328,6 +346,13 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -wm-low=COUNT      Start reclaiming below COUNT free user pages.\n"
+			"  -wm-high=COUNT     Reclaim until COUNT user pages are free.\n"
+			"  -zswap=COUNT       Keep up to COUNT pages of compressed swap in RAM.\n"
+			"  -ksm=COUNT         Scan COUNT pages for merging every 100 ms.\n"
+			"  -vmstat            Print paging statistics at process exit.\n"
 #endif
 			);
 	power_off ();
@@ -356,10 +381,16 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	journal_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	zswap_print_stats ();
+	ksm_print_stats ();
+#endif
 }
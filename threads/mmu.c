@@ -2,22 +2,200 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers (PCIDs).
+ *
+ * With CR4.PCIDE set, TLB entries are tagged with the PCID in the low bits
+ * of CR3, and loading CR3 with CR3_NOFLUSH keeps the entries of the new
+ * PCID instead of flushing the TLB.  A process switched back in then still
+ * finds its translations cached.
+ *
+ * A PCID is handed to each page map level 4 when it is activated, taking
+ * the least recently used one when all are taken; PCID 0 belongs to
+ * base_pml4.  Entries of a pml4 that is not active cannot be invlpg'd, so
+ * changing them marks its PCID stale instead, and the next activation
+ * flushes it. */
+#define PCID_CNT 64
+#define CR3_NOFLUSH (1ULL << 63)
+#define CR4_PCIDE (1 << 17)
+#define CPUID_1_ECX_PCID (1 << 17)
+
+/* PCIDs of a CPU (Pintos runs on just one).  Accessed with interrupts
+ * off. */
+struct pcid_cpu {
+	bool enabled;                   /* Does the CPU support PCIDs? */
+	uint64_t *owner[PCID_CNT];      /* Pml4 using each PCID, or NULL. */
+	bool stale[PCID_CNT];           /* Must be flushed on next use? */
+	uint64_t last_use[PCID_CNT];    /* CLOCK at last activation. */
+	uint64_t clock;
+};
+static struct pcid_cpu pcid_cpu;
+
+/* Enables PCIDs if the CPU supports them.  CR3 must hold base_pml4 with
+ * PCID 0. */
+void
+pml4_init_pcid (void) {
+	uint32_t a, b, c, d;
+
+	cpuid (1, &a, &b, &c, &d);
+	if (!(c & CPUID_1_ECX_PCID))
+		return;
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_cpu.enabled = true;
+	pcid_cpu.owner[0] = base_pml4;
+}
+
+/* Returns the PCID slot of PML4, or -1 if it has none.  Interrupts must be
+ * off. */
+static int
+pcid_find (uint64_t *pml4) {
+	for (int i = 0; i < PCID_CNT; i++)
+		if (pcid_cpu.owner[i] == pml4)
+			return i;
+	return -1;
+}
+
+/* Returns the CR3 bits that select a PCID for PML4, assigning one if
+ * needed.  Interrupts must be off. */
+static uint64_t
+pcid_get (uint64_t *pml4) {
+	int pcid = pcid_find (pml4);
+
+	if (pcid < 0) {
+		/* Reuse the least recently used PCID; its entries may belong to
+		 * somebody else, so it starts out stale. */
+		pcid = 1;
+		for (int i = 1; i < PCID_CNT; i++) {
+			if (pcid_cpu.owner[i] == NULL) {
+				pcid = i;
+				break;
+			}
+			if (pcid_cpu.last_use[i] < pcid_cpu.last_use[pcid])
+				pcid = i;
+		}
+		pcid_cpu.owner[pcid] = pml4;
+		pcid_cpu.stale[pcid] = true;
+	}
+	pcid_cpu.last_use[pcid] = ++pcid_cpu.clock;
+
+	uint64_t bits = pcid;
+	if (!pcid_cpu.stale[pcid])
+		bits |= CR3_NOFLUSH;
+	pcid_cpu.stale[pcid] = false;
+	return bits;
+}
+
+/* Invalidates the TLB entry of VA in PML4 after a change to it.  Only the
+ * active pml4 can be invalidated right away. */
+static void
+tlb_invalidate (uint64_t *pml4, uint64_t va) {
+	if (PTE_ADDR (rcr3 ()) == vtop (pml4))
+		invlpg (va);
+	else if (pcid_cpu.enabled) {
+		enum intr_level old_level = intr_disable ();
+		int pcid = pcid_find (pml4);
+		if (pcid >= 0)
+			pcid_cpu.stale[pcid] = true;
+		intr_set_level (old_level);
+	}
+}
+
+/* Populated counts.
+ *
+ * Every table of the hierarchy keeps the number of its present entries in
+ * the bits left to the OS (PTE_AVL) of its first COUNT_ENTRIES entries, a
+ * few bits in each.  The MMU ignores those bits, present entry or not.
+ * Walking a table then stops after its last present entry, and an empty
+ * table is passed over without reading it at all, so that a sparse
+ * address space (code at 0x400000, stack below KERN_BASE) is visited in
+ * time proportional to what is mapped rather than to the 512 GB it spans.
+ *
+ * The counts are right for every table filled in through this file; the
+ * kernel's page tables written directly by paging_init() are not, which
+ * is why only user space is ever walked by count. */
+#define COUNT_ENTRIES 4
+#define COUNT_SHIFT 9
+#define COUNT_BITS 3
+#define COUNT_MASK ((1 << COUNT_BITS) - 1)
+
+/* Returns the number of present entries in TABLE. */
+static unsigned
+table_count (const uint64_t *table) {
+	unsigned cnt = 0;
+	for (int i = 0; i < COUNT_ENTRIES; i++)
+		cnt |= ((table[i] & PTE_AVL) >> COUNT_SHIFT) << (i * COUNT_BITS);
+	return cnt;
+}
+
+/* Records CNT as the number of present entries in TABLE. */
+static void
+table_set_count (uint64_t *table, unsigned cnt) {
+	ASSERT (cnt <= PGSIZE / sizeof (uint64_t));
+	for (int i = 0; i < COUNT_ENTRIES; i++) {
+		uint64_t bits = (cnt >> (i * COUNT_BITS)) & COUNT_MASK;
+		table[i] = (table[i] & ~(uint64_t) PTE_AVL) | bits << COUNT_SHIFT;
+	}
+}
+
+/* Sets *ENTRY to VALUE, keeping the count bits stored in it and the count
+ * of its table up to date.  All changes to the present bit of an entry
+ * must go through here. */
+static void
+entry_set (uint64_t *entry, uint64_t value) {
+	uint64_t *table = pg_round_down (entry);
+	uint64_t old = *entry;
+
+	*entry = (value & ~(uint64_t) PTE_AVL) | (old & PTE_AVL);
+	if ((old ^ value) & PTE_P) {
+		unsigned cnt = table_count (table);
+		table_set_count (table, value & PTE_P ? cnt + 1 : cnt - 1);
+	}
+}
+
+/* Replaces the 2 MB mapping in *PDE by a page table that maps the same
+ * memory with 4 kB pages, carrying over the access bits.  Returns false if
+ * no page table could be allocated. */
+static bool
+split_huge_pde (uint64_t *pde) {
+	uint64_t *pt = palloc_get_page (0);
+	if (pt == NULL)
+		return false;
+
+	uint64_t pa = PTE_ADDR (*pde) & ~HUGE_PGMASK;
+	uint64_t flags = *pde & PTE_FLAGS & ~(PTE_PS | PTE_AVL);
+	for (unsigned i = 0; i < PGSIZE / sizeof (uint64_t); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	table_set_count (pt, PGSIZE / sizeof (uint64_t));
+	entry_set (pde, vtop (pt) | PTE_U | PTE_W | PTE_P);
+	return true;
+}
+
+/* Returns the entry for VA in page directory PDP.  A 2 MB mapping is
+ * returned as is, as the entry for all the pages it covers, unless CREATE
+ * is set: then it is split first, so that the page can be mapped on its
+ * own. */
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
+		if (((uint64_t) pte & PTE_P) && ((uint64_t) pte & PTE_PS)) {
+			if (!create)
+				return &pdp[idx];
+			if (!split_huge_pde (&pdp[idx]))
+				return NULL;
+		}
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page)
-					pdp[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+					entry_set (&pdp[idx], vtop (new_page) | PTE_U | PTE_W | PTE_P);
 				else
 					return NULL;
 			} else
@@ -39,7 +217,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page) {
-					pdpe[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+					entry_set (&pdpe[idx], vtop (new_page) | PTE_U | PTE_W | PTE_P);
 					allocated = 1;
 				} else
 					return NULL;
@@ -50,7 +228,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
-		pdpe[idx] = 0;
+		entry_set (&pdpe[idx], 0);
 	}
 	return pte;
 }
@@ -72,7 +250,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page) {
-					pml4e[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+					entry_set (&pml4e[idx], vtop (new_page) | PTE_U | PTE_W | PTE_P);
 					allocated = 1;
 				} else
 					return NULL;
@@ -83,7 +261,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
-		pml4e[idx] = 0;
+		entry_set (&pml4e[idx], 0);
 	}
 	return pte;
 }
@@ -100,16 +278,21 @@ pml4_create (void) {
 	return pml4;
 }
 
+/* The walks below go through the present entries of a table only, and
+ * stop once they have seen as many of them as the table counts. */
+
 static bool
 pt_for_each (uint64_t *pt, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index, unsigned pdx_index) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
+	unsigned left = table_count (pt);
+	for (unsigned i = 0; left > 0; i++) {
 		uint64_t *pte = &pt[i];
-		if (((uint64_t) *pte) & PTE_P) {
+		if (*pte & PTE_P) {
 			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
 								 ((uint64_t) pdp_index << PDPESHIFT) |
 								 ((uint64_t) pdx_index << PDXSHIFT) |
 								 ((uint64_t) i << PTXSHIFT));
+			left--;
 			if (!func (pte, va, aux))
 				return false;
 		}
@@ -117,15 +300,20 @@ pt_for_each (uint64_t *pt, pte_for_each_func *func, void *aux,
 	return true;
 }
 
+/* 2 MB mappings are only made for the VM subsystem, which keeps track of
+ * its pages on its own, and are skipped. */
 static bool
 pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+	unsigned left = table_count (pdp);
+	for (unsigned i = 0; left > 0; i++) {
+		if (!(pdp[i] & PTE_P))
+			continue;
+		left--;
+		if (!(pdp[i] & PTE_PS)
+				&& !pt_for_each (ptov (PTE_ADDR (pdp[i])), func, aux,
 					pml4_index, pdp_index, i))
-				return false;
+			return false;
 	}
 	return true;
 }
@@ -133,55 +321,64 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 static bool
 pdp_for_each (uint64_t *pdp,
 		pte_for_each_func *func, void *aux, unsigned pml4_index) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pde = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pde) & PTE_P)
-			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), func,
-					 aux, pml4_index, i))
-				return false;
+	unsigned left = table_count (pdp);
+	for (unsigned i = 0; left > 0; i++) {
+		if (!(pdp[i] & PTE_P))
+			continue;
+		left--;
+		if (!pgdir_for_each (ptov (PTE_ADDR (pdp[i])), func, aux,
+					pml4_index, i))
+			return false;
 	}
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each present pte entry of user space, which lies under
+ * the first pml4 entry.  The kernel's entries are the same in every pml4
+ * and are not visited. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pdpe = ptov((uint64_t *) pml4[i]);
-		if (((uint64_t) pdpe) & PTE_P)
-			if (!pdp_for_each ((uint64_t *) PTE_ADDR (pdpe), func, aux, i))
-				return false;
-	}
-	return true;
+	if (!(pml4[0] & PTE_P))
+		return true;
+	return pdp_for_each (ptov (PTE_ADDR (pml4[0])), func, aux, 0);
 }
 
+/* Frees page table PT and the pages mapped in it. */
 static void
 pt_destroy (uint64_t *pt) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pte = ptov((uint64_t *) pt[i]);
-		if (((uint64_t) pte) & PTE_P)
-			palloc_free_page ((void *) PTE_ADDR (pte));
-	}
+	unsigned left = table_count (pt);
+	for (unsigned i = 0; left > 0; i++)
+		if (pt[i] & PTE_P) {
+			palloc_free_page (ptov (PTE_ADDR (pt[i])));
+			left--;
+		}
 	palloc_free_page ((void *) pt);
 }
 
 static void
 pgdir_destroy (uint64_t *pdp) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+	unsigned left = table_count (pdp);
+	for (unsigned i = 0; left > 0; i++) {
+		if (!(pdp[i] & PTE_P))
+			continue;
+		if (pdp[i] & PTE_PS)
+			palloc_free_multiple (ptov (PTE_ADDR (pdp[i]) & ~HUGE_PGMASK),
+					HUGE_PGSIZE / PGSIZE);
+		else
+			pt_destroy (ptov (PTE_ADDR (pdp[i])));
+		left--;
 	}
 	palloc_free_page ((void *) pdp);
 }
 
 static void
 pdpe_destroy (uint64_t *pdpe) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-		uint64_t *pde = ptov((uint64_t *) pdpe[i]);
-		if (((uint64_t) pde) & PTE_P)
-			pgdir_destroy ((void *) PTE_ADDR (pde));
-	}
+	unsigned left = table_count (pdpe);
+	for (unsigned i = 0; left > 0; i++)
+		if (pdpe[i] & PTE_P) {
+			pgdir_destroy (ptov (PTE_ADDR (pdpe[i])));
+			left--;
+		}
 	palloc_free_page ((void *) pdpe);
 }
 
@@ -193,9 +390,17 @@ pml4_destroy (uint64_t *pml4) {
 	ASSERT (pml4 != base_pml4);
 
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
-	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
-	if (((uint64_t) pdpe) & PTE_P)
-		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+	if (pml4[0] & PTE_P)
+		pdpe_destroy (ptov (PTE_ADDR (pml4[0])));
+
+	/* A pml4 allocated at the same address must not inherit our PCID. */
+	if (pcid_cpu.enabled) {
+		enum intr_level old_level = intr_disable ();
+		int pcid = pcid_find (pml4);
+		if (pcid >= 0)
+			pcid_cpu.owner[pcid] = NULL;
+		intr_set_level (old_level);
+	}
 	palloc_free_page ((void *) pml4);
 }
 
@@ -203,7 +408,16 @@ pml4_destroy (uint64_t *pml4) {
  * register. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	if (!pcid_cpu.enabled) {
+		lcr3 (vtop (pml4));
+		return;
+	}
+
+	enum intr_level old_level = intr_disable ();
+	lcr3 (vtop (pml4) | pcid_get (pml4));
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,6 +430,9 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
+	if (pte && (*pte & PTE_P) && (*pte & PTE_PS))
+		return ptov (PTE_ADDR (*pte) & ~HUGE_PGMASK)
+			+ ((uint64_t) uaddr & HUGE_PGMASK);
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -238,30 +455,219 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
-		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	if (pte) {
+		uint64_t old = *pte;
+		entry_set (pte, vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U);
+		if (old & PTE_P)
+			tlb_invalidate (pml4, (uint64_t) upage);
+	}
 	return pte != NULL;
 }
 
+/* Returns the page directory entry for VA in PML4, or a null pointer if
+ * there is no page directory for it. */
+static uint64_t *
+pde_walk (uint64_t *pml4, const uint64_t va, bool create) {
+	uint64_t *pdpe, *pde;
+
+	if (!(pml4[PML4 (va)] & PTE_P)) {
+		if (!create || (pdpe = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		entry_set (&pml4[PML4 (va)], vtop (pdpe) | PTE_U | PTE_W | PTE_P);
+	}
+	pdpe = ptov (PTE_ADDR (pml4[PML4 (va)]));
+	if (!(pdpe[PDPE (va)] & PTE_P)) {
+		if (!create || (pde = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		entry_set (&pdpe[PDPE (va)], vtop (pde) | PTE_U | PTE_W | PTE_P);
+	}
+	pde = ptov (PTE_ADDR (pdpe[PDPE (va)]));
+	return &pde[PDX (va)];
+}
+
+/* Maps the 2 MB of user virtual memory at UPAGE to the 2 MB of physical
+ * memory at kernel virtual address KPAGE with a single page directory
+ * entry.  Both must be 2 MB aligned, and none of the pages in the range may
+ * be mapped yet.  Returns true if successful, false if memory allocation
+ * failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	ASSERT (((uint64_t) upage & HUGE_PGMASK) == 0);
+	ASSERT ((vtop (kpage) & HUGE_PGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	uint64_t *pde = pde_walk (pml4, (uint64_t) upage, true);
+	if (pde == NULL)
+		return false;
+
+	if (*pde & PTE_P) {
+		/* Drop the (empty) page table of the range. */
+		uint64_t *pt = ptov (PTE_ADDR (*pde));
+		ASSERT (table_count (pt) == 0);
+		palloc_free_page (pt);
+	}
+	entry_set (pde, vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U);
+	tlb_invalidate (pml4, (uint64_t) upage);
+	return true;
+}
+
+/* Returns true if UPAGE is mapped as part of a 2 MB page in PML4. */
+bool
+pml4_is_huge (uint64_t *pml4, const void *upage) {
+	uint64_t *pde = pde_walk (pml4, (uint64_t) upage, false);
+	return pde != NULL && (*pde & PTE_P) && (*pde & PTE_PS);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
- * UPAGE need not be mapped. */
+ * UPAGE need not be mapped.  If UPAGE is part of a 2 MB page, that is
+ * split into 4 kB pages first; if that fails for lack of memory, the whole
+ * 2 MB page is made not present. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
-	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	pte = pde_walk (pml4, (uint64_t) upage, false);
+	if (pte == NULL || !(*pte & PTE_P) || !(*pte & PTE_PS)
+			|| split_huge_pde (pte))
+		pte = pml4e_walk (pml4, (uint64_t) upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
-		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		entry_set (pte, *pte & ~PTE_P);
+		tlb_invalidate (pml4, (uint64_t) upage);
 	}
 }
 
+/* Range operations.  Calling pml4_set_page() and friends for each of many
+ * consecutive pages walks the four levels of tables from the root once per
+ * page.  The functions below walk them once per page table and step
+ * through its entries from there. */
+
+/* Maps the CNT user virtual pages from UPAGE to the frames at the kernel
+ * virtual addresses KPAGES[0] to KPAGES[CNT - 1], like pml4_set_page().
+ * None of the pages may be mapped yet.  Returns true if successful, false
+ * if one of them was mapped already or memory allocation failed, in which
+ * case none of them is mapped. */
+bool
+pml4_set_range (uint64_t *pml4, void *upage, void **kpages, size_t cnt,
+		bool rw) {
+	uint64_t va = (uint64_t) upage;
+	uint64_t *pte = NULL;
+	size_t i;
+
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	for (i = 0; i < cnt; i++, va += PGSIZE, pte++) {
+		if (pte == NULL || PTX (va) == 0) {
+			pte = pml4e_walk (pml4, va, 1);
+			if (pte == NULL)
+				break;
+		}
+		if (*pte & PTE_P)
+			break;
+		ASSERT (pg_ofs (kpages[i]) == 0);
+		entry_set (pte, vtop (kpages[i]) | PTE_P | (rw ? PTE_W : 0) | PTE_U);
+	}
+	if (i == cnt)
+		return true;
+
+	/* Only 4 kB entries were set, so this needs no split and cannot fail. */
+	pml4_clear_range (pml4, upage, i);
+	return false;
+}
+
+/* Stores into *PTE the entry for VA in PML4, for an update of the range
+ * of pages from VA to END, or a null pointer if VA has no page table.  A
+ * 2 MB page inside the range is returned as its page directory entry,
+ * setting *HUGE; one that sticks out of the range is split first.
+ * Returns false if that split fails for lack of memory. */
+static bool
+range_walk (uint64_t *pml4, uint64_t va, uint64_t end, uint64_t **pte,
+		bool *huge) {
+	uint64_t *pde = pde_walk (pml4, va, false);
+
+	*huge = false;
+	if (pde != NULL && (*pde & PTE_P) && (*pde & PTE_PS)) {
+		if ((va & HUGE_PGMASK) == 0 && end - va >= HUGE_PGSIZE) {
+			*huge = true;
+			*pte = pde;
+			return true;
+		}
+		if (!split_huge_pde (pde))
+			return false;
+	}
+	*pte = pml4e_walk (pml4, va, 0);
+	return true;
+}
+
+/* Clears the bits CLEAR and then sets the bits SET in the entries of the
+ * mapped pages among the CNT user virtual pages from UPAGE in PML4.
+ * Returns false if a 2 MB page that sticks out of the range could not be
+ * split for lack of memory, in which case only the pages before it have
+ * been updated. */
+static bool
+range_update (uint64_t *pml4, void *upage, size_t cnt, uint64_t clear,
+		uint64_t set) {
+	uint64_t va = (uint64_t) upage;
+	uint64_t end = va + cnt * PGSIZE;
+	uint64_t *pte = NULL;
+	bool huge = false;
+
+	ASSERT (pg_ofs (upage) == 0);
+
+	while (va < end) {
+		if (pte == NULL || PTX (va) == 0) {
+			if (!range_walk (pml4, va, end, &pte, &huge))
+				return false;
+			if (pte == NULL) {
+				/* No page table: skip to the next one. */
+				va = (va & ~HUGE_PGMASK) + HUGE_PGSIZE;
+				continue;
+			}
+		}
+		if (*pte & PTE_P) {
+			uint64_t old = *pte;
+			entry_set (pte, (old & ~clear) | set);
+			if (*pte != old)
+				tlb_invalidate (pml4, va);
+		}
+		if (huge) {
+			va += HUGE_PGSIZE;
+			pte = NULL;
+		} else {
+			va += PGSIZE;
+			pte++;
+		}
+	}
+	return true;
+}
+
+/* Marks the CNT user virtual pages from UPAGE not present in PML4, like
+ * pml4_clear_page().  A 2 MB page that lies within the range is made not
+ * present as a whole.  Returns false if a 2 MB page that sticks out of the
+ * range could not be split for lack of memory; the pages from there on
+ * are left as they were. */
+bool
+pml4_clear_range (uint64_t *pml4, void *upage, size_t cnt) {
+	return range_update (pml4, upage, cnt, PTE_P, 0);
+}
+
+/* Makes the mapped pages among the CNT user virtual pages from UPAGE in
+ * PML4 writable if RW is true, read-only otherwise.  Pages that are not
+ * mapped are left alone.  Returns false if a 2 MB page that sticks out of
+ * the range could not be split for lack of memory; the pages from there on
+ * are left as they were. */
+bool
+pml4_protect_range (uint64_t *pml4, void *upage, size_t cnt, bool rw) {
+	return range_update (pml4, upage, cnt, rw ? 0 : PTE_W, rw ? PTE_W : 0);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
@@ -283,8 +689,7 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
 
@@ -309,7 +714,6 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, (uint64_t) vpage);
 	}
 }
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -31,6 +32,8 @@ struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t usable_cnt;              /* Number of usable pages. */
+	size_t free_cnt;                /* Number of free pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +45,7 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void pool_adjust_free (struct pool *, long delta);
 
 /* multiboot info */
 struct multiboot_info {
@@ -232,6 +236,11 @@ split:
 			}
 		}
 	}
+
+	kernel_pool.usable_cnt = kernel_pool.free_cnt = bitmap_count (
+			kernel_pool.used_map, 0, bitmap_size (kernel_pool.used_map), false);
+	user_pool.usable_cnt = user_pool.free_cnt = bitmap_count (
+			user_pool.used_map, 0, bitmap_size (user_pool.used_map), false);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -265,6 +274,8 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 
 	lock_acquire (&pool->lock);
 	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	if (page_idx != BITMAP_ERROR)
+		pool_adjust_free (pool, -(long) page_cnt);
 	lock_release (&pool->lock);
 	void *pages;
 
@@ -284,6 +295,37 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Like palloc_get_multiple(), but the first page returned has a physical
+   address that is a multiple of ALIGN pages, as needed e.g. for memory
+   that is to be mapped as a huge page. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t bit_cnt = bitmap_size (pool->used_map);
+	size_t page_idx = BITMAP_ERROR;
+	size_t idx;
+
+	ASSERT (align > 0);
+	lock_acquire (&pool->lock);
+	for (idx = (align - pg_no (vtop (pool->base)) % align) % align;
+			idx + page_cnt <= bit_cnt; idx += align)
+		if (bitmap_none (pool->used_map, idx, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, idx, page_cnt, true);
+			pool_adjust_free (pool, -(long) page_cnt);
+			page_idx = idx;
+			break;
+		}
+	lock_release (&pool->lock);
+
+	void *pages = page_idx != BITMAP_ERROR
+		? pool->base + PGSIZE * page_idx : NULL;
+	if (pages != NULL && (flags & PAL_ZERO))
+		memset (pages, 0, PGSIZE * page_cnt);
+	if (pages == NULL && (flags & PAL_ASSERT))
+		PANIC ("palloc_get: out of pages");
+	return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -320,6 +362,19 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	pool_adjust_free (pool, page_cnt);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) {
+	return user_pool.free_cnt;
+}
+
+/* Returns the number of usable pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) {
+	return user_pool.usable_cnt;
 }
 
 /* Frees the page at PAGE. */
@@ -356,3 +411,13 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Adds DELTA to POOL's free page count.  Pages are freed without the pool
+   lock held, possibly with interrupts off from the scheduler, so the
+   update is made atomic by disabling interrupts instead. */
+static void
+pool_adjust_free (struct pool *pool, long delta) {
+	enum intr_level old_level = intr_disable ();
+	pool->free_cnt += delta;
+	intr_set_level (old_level);
+}
@@ -440,6 +440,83 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
 		cond_signal(cond, lock);
 }
 
+/* Initializes RWLOCK.  A readers-writer lock may be held by any
+   number of readers at once, or by a single writer.  Writers are
+   preferred: once a writer waits, new readers wait behind it, so
+   that a steady stream of readers cannot starve it.  A reader
+   may take the lock again while it holds it only if no writer
+   can be waiting, i.e. if whatever a writer would have to hold
+   first is held by the reader. */
+void rwlock_init(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_init(&rw->lock);
+	cond_init(&rw->readers_ok);
+	cond_init(&rw->writer_ok);
+	rw->readers = 0;
+	rw->writers_waiting = 0;
+	rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds or
+   waits for it. */
+void rwlock_acquire_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(rw->writer != thread_current());
+
+	lock_acquire(&rw->lock);
+	while (rw->writer != NULL || rw->writers_waiting > 0)
+		cond_wait(&rw->readers_ok, &rw->lock);
+	rw->readers++;
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, held for reading. */
+void rwlock_release_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_acquire(&rw->lock);
+	ASSERT(rw->readers > 0);
+	if (--rw->readers == 0 && !list_empty(&rw->writer_ok.waiters))
+		cond_signal(&rw->writer_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until nobody else holds it.
+   RW must not already be held by the current thread. */
+void rwlock_acquire_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(rw->writer != thread_current());
+
+	lock_acquire(&rw->lock);
+	rw->writers_waiting++;
+	while (rw->writer != NULL || rw->readers > 0)
+		cond_wait(&rw->writer_ok, &rw->lock);
+	rw->writers_waiting--;
+	rw->writer = thread_current();
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, held for writing by the current thread, to the
+   next writer if one waits, and to the readers otherwise. */
+void rwlock_release_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_acquire(&rw->lock);
+	ASSERT(rw->writer == thread_current());
+	rw->writer = NULL;
+	if (!list_empty(&rw->writer_ok.waiters))
+		cond_signal(&rw->writer_ok, &rw->lock);
+	else
+		cond_broadcast(&rw->readers_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
+
 /**
  * @brief 두 쓰레드의 우선순위를 비교하는 함수
  *
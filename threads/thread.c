@@ -948,6 +948,18 @@ void thread_all_calc_recent_cpu()
 	}
 }
 
+/* Invokes FUNC on all threads, passing along AUX.
+   This function must be called with interrupts off. */
+void thread_foreach(thread_action_func *func, void *aux)
+{
+	struct list_elem *e;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
+		func(list_entry(e, struct thread, all_elem), aux);
+}
+
 /* NOTE: [2.3] 자식 프로세스 검색 함수 구현 */
 struct thread *get_child_process(tid_t tid)
 {
@@ -110,10 +110,40 @@ tid_t process_fork(const char *name, struct intr_frame *if_)
  * pml4_for_each. This is only for the project 2. */
 
 /* NOTE: [2.5] 전체 사용자 메모리 공간을 복사하는 함수에서 빠진 부분 구현 */
+/* Pages copied from the parent that duplicate_pte() maps into the
+ * child together. */
+#define DUP_BATCH 32
+
+/* A run of consecutive pages copied from the parent but not mapped
+ * into the child yet. */
+struct dup_batch
+{
+	struct thread *parent;
+	uint8_t *upage;          /* First page of the run. */
+	void *kpages[DUP_BATCH]; /* Copies of the pages. */
+	size_t cnt;              /* Number of pages in the run. */
+	bool writable;           /* Are the pages writable? */
+};
+
+/* Maps the run of pages in B into the current thread, walking its
+ * page table once for all of them. */
+static bool flush_dup_batch(struct dup_batch *b)
+{
+	if (b->cnt > 0 && !pml4_set_range(thread_current()->pml4, b->upage,
+									  b->kpages, b->cnt, b->writable))
+	{
+		while (b->cnt > 0)
+			palloc_free_page(b->kpages[--b->cnt]);
+		return false;
+	}
+	b->cnt = 0;
+	return true;
+}
+
 static bool duplicate_pte(uint64_t *pte, void *va, void *aux)
 {
-	struct thread *current = thread_current();
-	struct thread *parent = (struct thread *)aux;
+	struct dup_batch *b = aux;
+	struct thread *parent = b->parent;
 	void *parent_page;
 	void *newpage;
 	bool writable;
@@ -136,13 +166,24 @@ static bool duplicate_pte(uint64_t *pte, void *va, void *aux)
 	memcpy(newpage, parent_page, PGSIZE);
 	writable = is_writable(pte);
 
-	/* 5. Add new page to child's page table at address VA with WRITABLE permission. */
-	if (!pml4_set_page(current->pml4, va, newpage, writable))
+	/* 5. Add new page to child's page table at address VA with WRITABLE permission,
+	 * together with the pages before it if they make a run. */
+	if (b->cnt > 0 && (b->cnt == DUP_BATCH || writable != b->writable
+					   || (uint8_t *)va != b->upage + b->cnt * PGSIZE))
 	{
-		/* 6. NOTE: if fail to insert page, do error handling. */
-		palloc_free_page(newpage);
-		return false;
+		if (!flush_dup_batch(b))
+		{
+			/* 6. NOTE: if fail to insert page, do error handling. */
+			palloc_free_page(newpage);
+			return false;
+		}
 	}
+	if (b->cnt == 0)
+	{
+		b->upage = va;
+		b->writable = writable;
+	}
+	b->kpages[b->cnt++] = newpage;
 	return true;
 }
 #endif
@@ -176,9 +217,18 @@ __do_fork(void *aux)
 	supplemental_page_table_init(&current->spt);
 	if (!supplemental_page_table_copy(&current->spt, &parent->spt))
 		goto error;
+	current->heap_start = parent->heap_start;
+	current->heap_break = parent->heap_break;
+	current->stack_bottom = parent->stack_bottom;
+	current->stack_chunk = parent->stack_chunk;
 #else
-	if (!pml4_for_each(parent->pml4, duplicate_pte, parent))
+	struct dup_batch batch = {.parent = parent, .cnt = 0};
+	if (!pml4_for_each(parent->pml4, duplicate_pte, &batch) || !flush_dup_batch(&batch))
+	{
+		while (batch.cnt > 0)
+			palloc_free_page(batch.kpages[--batch.cnt]);
 		goto error;
+	}
 #endif
 	/* NOTE: Your code goes here.
 	 * NOTE: Hint) To duplicate the file object, use `file_duplicate`
@@ -238,11 +288,13 @@ int process_exec(void *f_name) /* NOTE: 강의의 start_process() */
 
 	/* We first kill the current context */
 	process_cleanup();
+#ifdef VM
+	/* NOTE: [3.1] 이전 SPT는 process_cleanup()에서 파괴되었으므로 새로 초기화 */
+	supplemental_page_table_init(&thread_current()->spt);
+#endif
 
-	lock_acquire(&filesys_lock);
 	/* And then load the binary */
 	success = load(file_name, &_if);
-	lock_release(&filesys_lock);
 
 	/* NOTE: [2.3] 메모리 적재 완료 시 부모 프로세스 다시 진행 (세마포어 이용) */
 	// sema_up(&thread_current()->load_sema);
@@ -524,6 +576,7 @@ load(const char *file_name, struct intr_frame *if_)
 	off_t file_ofs;
 	bool success = false;
 	int i;
+	uint64_t seg_end = 0;
 
 	// hex_dump(&file_ofs, )
 	/* Allocate and activate page directory. */
@@ -599,6 +652,8 @@ load(const char *file_name, struct intr_frame *if_)
 				if (!load_segment(file, file_page, (void *)mem_page,
 								  read_bytes, zero_bytes, writable))
 					goto done;
+				if (seg_end < mem_page + read_bytes + zero_bytes)
+					seg_end = mem_page + read_bytes + zero_bytes;
 			}
 			else
 				goto done;
@@ -608,6 +663,10 @@ load(const char *file_name, struct intr_frame *if_)
 	/* NOTE: [2.5] 파일 open 시 file_deny_write() 호출 / thread 구조체에 실행 중인 파일 추가 */
 	file_deny_write(file);
 	t->run_file = file;
+#ifdef VM
+	/* NOTE: [3.4] 힙은 비어 있는 채로 마지막 세그먼트 다음 페이지에서 시작 */
+	t->heap_start = t->heap_break = (uint8_t *)seg_end;
+#endif
 
 	/* Set up stack. */
 	if (!setup_stack(if_))
@@ -675,7 +734,11 @@ validate_segment(const struct Phdr *phdr, struct file *file)
  * outside of #ifndef macro. */
 
 /* load() helpers. */
-static bool install_page(void *upage, void *kpage, bool writable);
+static bool install_pages(void *upage, void **kpages, size_t cnt,
+						  bool writable);
+
+/* Pages of a segment loaded and mapped together by load_segment(). */
+#define LOAD_BATCH 32
 
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
@@ -695,6 +758,9 @@ static bool
 load_segment(struct file *file, off_t ofs, uint8_t *upage,
 			 uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
+	void *kpages[LOAD_BATCH];
+	size_t cnt = 0;
+
 	ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT(pg_ofs(upage) == 0);
 	ASSERT(ofs % PGSIZE == 0);
@@ -711,43 +777,47 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 		/* Get a page of memory. */
 		uint8_t *kpage = palloc_get_page(PAL_USER);
 		if (kpage == NULL)
-			return false;
+			goto fail;
+		kpages[cnt++] = kpage;
 
 		/* Load this page. */
 		if (file_read(file, kpage, page_read_bytes) != (int)page_read_bytes)
-		{
-			palloc_free_page(kpage);
-			return false;
-		}
+			goto fail;
 		memset(kpage + page_read_bytes, 0, page_zero_bytes);
 
-		/* Add the page to the process's address space. */
-		if (!install_page(upage, kpage, writable))
-		{
-			printf("fail\n");
-			palloc_free_page(kpage);
-			return false;
-		}
-
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
+
+		/* Add a batch of pages to the process's address space at once. */
+		if (cnt == LOAD_BATCH || (read_bytes == 0 && zero_bytes == 0))
+		{
+			if (!install_pages(upage, kpages, cnt, writable))
+				goto fail;
+			upage += cnt * PGSIZE;
+			cnt = 0;
+		}
 	}
 	return true;
+
+fail:
+	while (cnt > 0)
+		palloc_free_page(kpages[--cnt]);
+	return false;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the USER_STACK */
 static bool
 setup_stack(struct intr_frame *if_)
 {
-	uint8_t *kpage;
+	void *kpage;
 	bool success = false;
 
 	kpage = palloc_get_page(PAL_USER | PAL_ZERO);
 	if (kpage != NULL)
 	{
-		success = install_page(((uint8_t *)USER_STACK) - PGSIZE, kpage, true);
+		success = install_pages(((uint8_t *)USER_STACK) - PGSIZE, &kpage, 1,
+								true);
 		if (success)
 			if_->rsp = USER_STACK;
 		else
@@ -756,35 +826,43 @@ setup_stack(struct intr_frame *if_)
 	return success;
 }
 
-/* Adds a mapping from user virtual address UPAGE to kernel
- * virtual address KPAGE to the page table.
- * If WRITABLE is true, the user process may modify the page;
- * otherwise, it is read-only.
- * UPAGE must not already be mapped.
- * KPAGE should probably be a page obtained from the user pool
+/* Adds mappings from the CNT user virtual pages starting at UPAGE
+ * to the kernel virtual addresses in KPAGES to the page table.
+ * If WRITABLE is true, the user process may modify the pages;
+ * otherwise, they are read-only.
+ * The pages must not already be mapped.
+ * KPAGES should probably be pages obtained from the user pool
  * with palloc_get_page().
- * Returns true on success, false if UPAGE is already mapped or
- * if memory allocation fails. */
+ * Returns true on success, false if one of the pages is already
+ * mapped or if memory allocation fails, in which case none of
+ * them is mapped. */
 static bool
-install_page(void *upage, void *kpage, bool writable)
+install_pages(void *upage, void **kpages, size_t cnt, bool writable)
 {
 	struct thread *t = thread_current();
 
-	/* Verify that there's not already a page at that virtual
-	 * address, then map our page there. */
-	return (pml4_get_page(t->pml4, upage) == NULL && pml4_set_page(t->pml4, upage, kpage, writable));
+	/* Walks the page table once for all the pages, instead of once
+	 * per page. */
+	return pml4_set_range(t->pml4, upage, kpages, cnt, writable);
 }
 #else
 /* From here, codes will be used after project 3.
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* NOTE: [3.2] 첫 페이지 폴트 시 세그먼트 내용을 파일에서 읽어 오는 함수 /
+ * AUX는 load_segment()가 할당한 struct file_page (파일 오프셋, 읽을 바이트 수).
+ * 로드가 끝난 페이지는 평범한 익명 페이지이므로 파일 매핑 참조를 놓는다. */
 static bool
 lazy_load_segment(struct page *page, void *aux)
 {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+	struct file_page *fp = aux;
+	bool success = file_mapping_read(page->map, page->frame->kva, fp) == (off_t)fp->read_bytes;
+
+	free(fp);
+	file_mapping_put(page->map);
+	page->map = NULL;
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -809,6 +887,18 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT(pg_ofs(upage) == 0);
 	ASSERT(ofs % PGSIZE == 0);
 
+	/* NOTE: [3.2] 세그먼트 하나를 하나의 파일 매핑으로 묶어 fault-around/readahead 단위로 사용 */
+	struct file *mfile = file_reopen(file);
+	if (mfile == NULL)
+		return false;
+	struct file_mapping *map = file_mapping_create(mfile, upage, (read_bytes + zero_bytes) / PGSIZE);
+	if (map == NULL)
+	{
+		file_close(mfile);
+		return false;
+	}
+
+	bool success = true;
 	while (read_bytes > 0 || zero_bytes > 0)
 	{
 		/* Do calculate how to fill this page.
@@ -817,18 +907,31 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer(VM_ANON, upage,
-											writable, lazy_load_segment, aux))
-			return false;
+		/* NOTE: [3.2] lazy_load_segment에 넘길 파일 오프셋과 읽을 바이트 수 */
+		struct file_page *aux = malloc(sizeof *aux);
+		if (aux == NULL)
+		{
+			success = false;
+			break;
+		}
+		aux->offset = ofs;
+		aux->read_bytes = page_read_bytes;
+		if (!vm_alloc_mapped_page(VM_ANON, upage,
+								  writable, lazy_load_segment, aux, map))
+		{
+			free(aux);
+			success = false;
+			break;
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
-	return true;
+	file_mapping_put(map);
+	return success;
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -838,10 +941,17 @@ setup_stack(struct intr_frame *if_)
 	bool success = false;
 	void *stack_bottom = (void *)(((uint8_t *)USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
+	/* NOTE: [3.3] 스택 페이지(VM_MARKER_0)를 만들고 바로 물리 프레임 할당 */
+	if (vm_alloc_page(VM_ANON | VM_MARKER_0, stack_bottom, true))
+	{
+		success = vm_claim_page(stack_bottom);
+		if (success)
+		{
+			if_->rsp = USER_STACK;
+			thread_current()->stack_bottom = stack_bottom;
+			thread_current()->stack_chunk = 0;
+		}
+	}
 
 	return success;
 }
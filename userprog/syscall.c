@@ -16,6 +16,11 @@
 #include "userprog/process.h"
 #include "devices/input.h"
 #include "threads/palloc.h"
+#ifdef VM
+#include <round.h>
+#include "vm/vm.h"
+#include "vm/madvise.h"
+#endif
 
 void syscall_entry(void);
 void syscall_handler(struct intr_frame *);
@@ -50,12 +55,27 @@ int write(int fd, const void *buffer, unsigned size);
 void seek(int fd, unsigned position);
 unsigned tell(int fd);
 void close(int fd);
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
+void munmap(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int mincore(void *addr, size_t length, unsigned char *vec);
+int mlock(const void *addr, size_t length);
+int munlock(const void *addr, size_t length);
+void *sys_brk(void *addr);
+int vmstat(struct vmstat *st);
 
 /* file */
 bool create(const char *file, unsigned initial_size);
 bool remove(const char *file);
 
 void check_address(void *addr);
+void check_buffer(const void *buffer, unsigned size, bool to_write);
+void release_buffer(const void *buffer, unsigned size);
+
+/* NOTE: [2.4] File에 대한 동시 접근을 막기 위한 filesys_lock */
+/* 파일 시스템은 inode, 디렉터리, 할당기마다 자체 락을 가지므로 (filesys.c 참고)
+ * 파일 시스템 콜은 이 락을 잡지 않음. 페이지 캐시도 자체 락(page_cache_lock)을 가짐 */
+struct lock filesys_lock;
 
 void syscall_init(void)
 {
@@ -79,6 +99,10 @@ void syscall_handler(struct intr_frame *f)
 	// NOTE: [2.X] Your implementation goes here.
 	/* TODO: [2.5] fork 추가 */
 	uint64_t syscall_num = f->R.rax;
+#ifdef VM
+	/* NOTE: [3.3] 시스템 콜 중 발생한 페이지 폴트의 스택 성장 판단을 위해 유저 rsp 저장 */
+	thread_current()->user_rsp = f->rsp;
+#endif
 
 	switch (syscall_num)
 	{
@@ -124,6 +148,32 @@ void syscall_handler(struct intr_frame *f)
 	case SYS_CLOSE: // 13
 		close(f->R.rdi);
 		break;
+#ifdef VM
+	case SYS_MMAP: // 14
+		f->R.rax = (uint64_t)mmap((void *)f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
+		break;
+	case SYS_MUNMAP: // 15
+		munmap((void *)f->R.rdi);
+		break;
+	case SYS_MADVISE:
+		f->R.rax = madvise((void *)f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	case SYS_MINCORE:
+		f->R.rax = mincore((void *)f->R.rdi, f->R.rsi, (unsigned char *)f->R.rdx);
+		break;
+	case SYS_MLOCK:
+		f->R.rax = mlock((const void *)f->R.rdi, f->R.rsi);
+		break;
+	case SYS_MUNLOCK:
+		f->R.rax = munlock((const void *)f->R.rdi, f->R.rsi);
+		break;
+	case SYS_BRK:
+		f->R.rax = (uint64_t)sys_brk((void *)f->R.rdi);
+		break;
+	case SYS_VMSTAT:
+		f->R.rax = vmstat((struct vmstat *)f->R.rdi);
+		break;
+#endif
 	}
 }
 
@@ -145,6 +195,10 @@ void exit(int status)
 
 	/* 프로세스 종료 메시지 출력, 출력 양식: “프로세스이름 : exit(종료상태 )” */
 	printf("%s: exit(%d)\n", curr->name, status);
+#ifdef VM
+	/* NOTE: [3.5] -vmstat 옵션이 주어졌다면 페이지 폴트 통계도 출력 */
+	vmstat_print(curr);
+#endif
 	/* 스레드 종료 */
 	thread_exit();
 }
@@ -184,10 +238,8 @@ bool create(const char *file, unsigned initial_size)
 	check_address(file);
 
 	bool success;
-	lock_acquire(&filesys_lock);
 	/* 파일 이름과 크기에 해당하는 파일 생성*/
 	success = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
 	/* 파일 생성 성공 시 true 반환, 실패 시 false 반환 */
 	return success;
 }
@@ -198,10 +250,8 @@ bool remove(const char *file)
 	check_address(file);
 
 	bool success;
-	lock_acquire(&filesys_lock);
 	/* 파일 이름에 해당하는 파일을 제거*/
 	success = filesys_remove(file);
-	lock_release(&filesys_lock);
 	/* 파일 제거 성공 시 true 반환, 실패 시 false 반환 */
 	return success;
 }
@@ -210,7 +260,6 @@ bool remove(const char *file)
 int open(const char *file_name)
 {
 	check_address(file_name);
-	lock_acquire(&filesys_lock);
 	/* 파일을 open */
 	int fd = -1;
 	struct file *file = filesys_open(file_name);
@@ -221,7 +270,6 @@ int open(const char *file_name)
 		fd = process_add_file(file);
 	if (fd == -1)
 		file_close(file);
-	lock_release(&filesys_lock);
 
 	/* 해당 파일이 존재하지 않으면 -1 리턴 */
 	return fd;
@@ -230,7 +278,6 @@ int open(const char *file_name)
 /* NOTE: [2.4] filesize() 시스템 콜 구현 */
 int filesize(int fd)
 {
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	int size = -1;
@@ -238,7 +285,6 @@ int filesize(int fd)
 	if (file != NULL)
 		size = file_length(file);
 
-	lock_release(&filesys_lock);
 	/* 해당 파일이 존재하지 않으면 -1 리턴 */
 	return size;
 }
@@ -246,10 +292,9 @@ int filesize(int fd)
 /* NOTE: [2.4] read() 시스템 콜 구현 */
 int read(int fd, void *buffer, unsigned size)
 {
-	check_address(buffer);
+	check_buffer(buffer, size, true);
 
-	/* 파일에 동시 접근이 일어날 수 있으므로 Lock 사용 */
-	lock_acquire(&filesys_lock);
+	int bytes = -1;
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	/* 파일 디스크립터가 0일 경우 키보드에 입력을 버퍼에 저장 후 버퍼의 저장한 크기를 리턴 (input_getc() 이용) */
@@ -257,70 +302,55 @@ int read(int fd, void *buffer, unsigned size)
 	{
 		uint8_t user_input = input_getc();
 		memcpy(buffer, &user_input, sizeof(user_input));
-		lock_release(&filesys_lock);
-		return sizeof(user_input);
+		bytes = sizeof(user_input);
 	}
 	/* 파일 디스크립터가 0이 아닐 경우 파일의 데이터를 크기만큼 저장 후 읽은 바이트 수를 리턴 */
-	if (fd >= 2 && file)
-	{
-		int bytes = file_read(file, buffer, size);
-		lock_release(&filesys_lock);
-		return bytes;
-	}
-	lock_release(&filesys_lock);
-	return -1;
+	else if (fd >= 2 && file)
+		bytes = file_read(file, buffer, size);
+	release_buffer(buffer, size);
+	return bytes;
 }
 
 /* NOTE: [2.4] write() 시스템 콜 구현 */
 int write(int fd, const void *buffer, unsigned size)
 {
-	check_address(buffer);
+	check_buffer(buffer, size, false);
 
-	/* 파일에 동시 접근이 일어날 수 있으므로 Lock 사용 */
-	lock_acquire(&filesys_lock);
+	int bytes = -1;
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	/* 파일 디스크립터가 1일 경우 버퍼에 저장된 값을 화면에 출력 후 버퍼의 크기 리턴 (putbuf() 이용) */
 	if (fd == 1)
 	{
 		putbuf(buffer, size);
-		lock_release(&filesys_lock);
-		return sizeof(buffer);
+		bytes = sizeof(buffer);
 	}
 	/* 파일 디스크립터가 1이 아닐 경우 버퍼에 저장된 데이터를 크기만큼 파일에 기록 후 기록한 바이트 수를 리턴 */
-	if (fd >= 2 && file)
-	{
-		int bytes = file_write(file, buffer, size);
-		lock_release(&filesys_lock);
-		return bytes;
-	}
-	lock_release(&filesys_lock);
-	return -1;
+	else if (fd >= 2 && file)
+		bytes = file_write(file, buffer, size);
+	release_buffer(buffer, size);
+	return bytes;
 }
 
 /* NOTE: [2.4] seek() 시스템 콜 구현 */
 void seek(int fd, unsigned position)
 {
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	/* 해당 열린 파일의 위치(offset)를 position만큼 이동 */
 	if (file)
 		file_seek(file, position);
-	lock_release(&filesys_lock);
 }
 
 /* NOTE: [2.4] tell() 시스템 콜 구현 */
 unsigned tell(int fd)
 {
-	lock_acquire(&filesys_lock);
 	/* 파일 디스크립터를 이용하여 파일 객체 검색 */
 	struct file *file = process_get_file(fd);
 	unsigned position = -1;
 	/* 해당 열린 파일의 위치를 반환 */
 	if (file)
 		position = file_tell(file);
-	lock_release(&filesys_lock);
 	return position;
 }
 
@@ -331,6 +361,93 @@ void close(int fd)
 	process_close_file(fd);
 }
 
+#ifdef VM
+/* NOTE: [3.4] mmap() 시스템 콜 구현 */
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset)
+{
+	/* NOTE: [3.4] 익명 매핑은 주소를 NULL로 주면 커널이 빈 영역을 골라 줌 */
+	if (fd == MAP_ANONYMOUS && addr == NULL && length > 0)
+		return do_mmap_anon(NULL, length, writable);
+
+	/* 주소와 오프셋은 페이지 정렬, 매핑 범위는 모두 유저 영역이어야 함 */
+	if (addr == NULL || pg_ofs(addr) != 0 || offset % PGSIZE != 0)
+		return NULL;
+	if (length == 0 || is_kernel_vaddr(addr) || (uint64_t)addr + length < (uint64_t)addr || is_kernel_vaddr((uint64_t)addr + length - 1))
+		return NULL;
+	if (fd == MAP_ANONYMOUS)
+		return do_mmap_anon(addr, length, writable);
+
+	/* 파일 디스크립터를 이용하여 파일 객체 검색 (표준 입출력은 매핑 불가) */
+	struct file *file = process_get_file(fd);
+	if (file == NULL)
+		return NULL;
+
+	return do_mmap(addr, length, writable, file, offset);
+}
+
+/* NOTE: [3.4] munmap() 시스템 콜 구현 */
+void munmap(void *addr)
+{
+	do_munmap(addr);
+}
+
+/* NOTE: [3.4] brk() 시스템 콜 구현 - 힙의 끝을 ADDR로 옮기고 새 끝을 반환 (NULL이면 조회만) */
+void *sys_brk(void *addr)
+{
+	return do_brk(addr);
+}
+
+/* NOTE: [3.5] vmstat() 시스템 콜 구현 - 현재 프로세스의 페이지 폴트/워킹셋 통계를 ST에 복사 */
+int vmstat(struct vmstat *st)
+{
+	const struct vm_stats *vs = &thread_current()->vm_stats;
+
+	check_buffer(st, sizeof *st, true);
+	st->minor_faults = vs->minor_faults;
+	st->major_faults = vs->major_faults;
+	st->cow_faults = vs->cow_faults;
+	st->stack_faults = vs->stack_faults;
+	st->evictions = vs->evictions;
+	st->wss = vs->wss;
+	st->wss_peak = vs->wss_peak;
+	st->stack_prefaults = vs->stack_prefaults;
+	release_buffer(st, sizeof *st);
+	return 0;
+}
+
+/* NOTE: [3.5] madvise() 시스템 콜 구현 - 페이지 사용 패턴에 대한 힌트 */
+int madvise(void *addr, size_t length, int advice)
+{
+	return vm_madvise(addr, length, advice);
+}
+
+/* NOTE: [3.5] mincore() 시스템 콜 구현 - 페이지당 1바이트로 상주 여부를 VEC에 기록 */
+int mincore(void *addr, size_t length, unsigned char *vec)
+{
+	unsigned vec_size = DIV_ROUND_UP(length, PGSIZE);
+	if (vec_size == 0)
+		return vm_mincore(addr, length, vec);
+
+	/* 커널이 직접 쓰는 버퍼이므로 미리 고정 */
+	check_buffer(vec, vec_size, true);
+	int ret = vm_mincore(addr, length, vec);
+	release_buffer(vec, vec_size);
+	return ret;
+}
+
+/* NOTE: [3.5] mlock() 시스템 콜 구현 - 범위 내 페이지를 메모리에 고정 */
+int mlock(const void *addr, size_t length)
+{
+	return vm_mlock((void *)addr, length);
+}
+
+/* NOTE: [3.5] munlock() 시스템 콜 구현 - mlock() 해제 */
+int munlock(const void *addr, size_t length)
+{
+	return vm_munlock((void *)addr, length);
+}
+#endif
+
 /* ---------- UTIL ---------- */
 /* NOTE: [2.2] 추가 함수 - 주소 값이 유저 영역에서 사용하는 주소 값인지 확인하는 함수 */
 void check_address(void *addr)
@@ -338,3 +455,43 @@ void check_address(void *addr)
 	if (addr == NULL || is_kernel_vaddr(addr))
 		exit(-1);
 }
+
+/* NOTE: [3.3] 버퍼 전체가 유효한 유저 메모리인지 확인하는 함수 /
+ * VM에서는 락을 잡기 전에 버퍼의 모든 페이지를 미리 폴트시켜 둔다.
+ * 파일 읽기 도중(디스크 락을 잡은 채로) 페이지 폴트가 나는 것을 막기 위함. */
+void check_buffer(const void *buffer, unsigned size UNUSED, bool to_write UNUSED)
+{
+	check_address((void *)buffer);
+#ifdef VM
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	for (uint8_t *upage = pg_round_down(buffer); upage < (uint8_t *)buffer + size; upage += PGSIZE)
+	{
+		check_address(upage);
+		/* 페이지를 한 바이트 읽어 lazy loading/스택 성장을 유도 */
+		*(volatile uint8_t *)(upage < (uint8_t *)buffer ? buffer : upage);
+
+		/* 커널이 써야 하는 버퍼가 읽기 전용 페이지라면 종료 */
+		struct page *page = spt_find_page(spt, upage);
+		if (page == NULL || (to_write && !page->writable))
+			exit(-1);
+
+		/* 시스템 콜이 끝날 때까지 페이지가 eviction 되지 않도록 고정 */
+		if (!vm_pin_page(page, to_write))
+			exit(-1);
+	}
+#endif
+}
+
+/* NOTE: [3.4] check_buffer()에서 고정한 버퍼 페이지들의 고정을 해제하는 함수 */
+void release_buffer(const void *buffer UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	for (uint8_t *upage = pg_round_down(buffer); upage < (uint8_t *)buffer + size; upage += PGSIZE)
+	{
+		struct page *page = spt_find_page(spt, upage);
+		if (page != NULL)
+			vm_unpin_page(page);
+	}
+#endif
+}
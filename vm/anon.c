@@ -1,7 +1,24 @@
-/* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
+/* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page).
+ * Evicted pages go to the compressed in-memory tier (see zswap.c) when it
+ * has room for them, and to the swap disk otherwise.  Anonymous mmap()s
+ * and the brk() heap are made of such pages. */
 
 #include "vm/vm.h"
+#include <bitmap.h>
+#include <round.h>
+#include <string.h>
 #include "devices/disk.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of swap disk sectors in one page-sized swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Where anonymous mmap() looks for room when the caller leaves the
+ * address to us: far above the heap, below the kernel. */
+#define ANON_MMAP_BASE ((uint8_t *) 0x1000000000)
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,11 +34,22 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Swap slots in use, one bit per page-sized slot of the swap disk. */
+static struct bitmap *swap_table;
+static struct lock swap_lock;
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	if (swap_disk == NULL)
+		PANIC ("hd1:1 (hdd) not present, swap initialization failed");
+
+	swap_table = bitmap_create (disk_size (swap_disk) / SECTORS_PER_SLOT);
+	if (swap_table == NULL)
+		PANIC ("swap table creation failed");
+	lock_init (&swap_lock);
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
@@ -31,22 +59,195 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->swap_slot = BITMAP_ERROR;
+	anon_page->zswap.chunk = BITMAP_ERROR;
+	return true;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = anon_page->swap_slot;
+
+	if (zswap_load (&anon_page->zswap, kva))
+		return true;
+	if (slot == BITMAP_ERROR) {
+		/* Dropped by anon_discard(): back to zeros. */
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+
+	for (size_t i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+				kva + i * DISK_SECTOR_SIZE);
+	thread_current ()->vm_stats.disk_reads++;
+
+	lock_acquire (&swap_lock);
+	bitmap_reset (swap_table, slot);
+	lock_release (&swap_lock);
+	anon_page->swap_slot = BITMAP_ERROR;
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (zswap_store (page->frame->kva, &anon_page->zswap))
+		return true;
+
+	lock_acquire (&swap_lock);
+	size_t slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return false;
+
+	for (size_t i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+				page->frame->kva + i * DISK_SECTOR_SIZE);
+	anon_page->swap_slot = slot;
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	/* Freeing the frame waits out an eviction in progress, after which
+	 * the contents may have landed in swap. */
+	if (page->frame != NULL)
+		vm_free_frame (page);
+	anon_discard (page);
+	file_mapping_put (page->map);
+	page->map = NULL;
+}
+
+/* Frees the copy of PAGE, which is not resident, kept in swap or in
+ * zswap, if any.  The next swap-in of PAGE then zero-fills it. */
+void
+anon_discard (struct page *page) {
+	struct anon_page *anon_page = &page->anon;
+
+	ASSERT (page->frame == NULL);
+	if (anon_page->swap_slot != BITMAP_ERROR) {
+		lock_acquire (&swap_lock);
+		bitmap_reset (swap_table, anon_page->swap_slot);
+		lock_release (&swap_lock);
+		anon_page->swap_slot = BITMAP_ERROR;
+	}
+	zswap_free (&anon_page->zswap);
+}
+
+/* Returns true if none of the PAGE_CNT pages at UPAGE is in use. */
+static bool
+range_free (uint8_t *upage, size_t page_cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (size_t i = 0; i < page_cnt; i++)
+		if (spt_find_page (spt, upage + i * PGSIZE) != NULL)
+			return false;
+	return true;
+}
+
+/* Finds PAGE_CNT unused pages in a row above ANON_MMAP_BASE.  Runs of a
+ * huge page or more are aligned so that they can be backed by huge
+ * pages. */
+static uint8_t *
+find_anon_range (size_t page_cnt) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t align = page_cnt * PGSIZE >= HUGE_PGSIZE ? HUGE_PGSIZE : PGSIZE;
+	uint8_t *start = ANON_MMAP_BASE;
+
+	if (page_cnt > pg_no (KERN_BASE) - pg_no (ANON_MMAP_BASE))
+		return NULL;
+	while (is_user_vaddr (start + page_cnt * PGSIZE - 1)) {
+		size_t i;
+		for (i = 0; i < page_cnt; i++)
+			if (spt_find_page (spt, start + i * PGSIZE) != NULL)
+				break;
+		if (i == page_cnt)
+			return start;
+		start = (uint8_t *) ROUND_UP ((uint64_t) (start + (i + 1) * PGSIZE),
+				align);
+	}
+	return NULL;
+}
+
+/* Maps LENGTH bytes of zero-filled memory at ADDR, or at an address of
+ * our choosing if ADDR is null.  The pages are only allocated when first
+ * touched and can be swapped out like any other anonymous page.  Returns
+ * the address of the mapping, or NULL on failure. */
+void *
+do_mmap_anon (void *addr, size_t length, bool writable) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	uint8_t *upage = addr;
+	size_t i;
+
+	if (upage == NULL)
+		upage = find_anon_range (page_cnt);
+	else if (!range_free (upage, page_cnt))
+		upage = NULL;
+	if (upage == NULL)
+		return NULL;
+
+	struct file_mapping *map = file_mapping_create (NULL, upage, page_cnt);
+	if (map == NULL)
+		return NULL;
+	for (i = 0; i < page_cnt; i++)
+		if (!vm_alloc_mapped_page (VM_ANON, upage + i * PGSIZE, writable,
+					NULL, NULL, map))
+			break;
+
+	if (i < page_cnt) {
+		/* Roll back the pages that made it in. */
+		while (i-- > 0)
+			spt_remove_page (spt, spt_find_page (spt, upage + i * PGSIZE));
+		upage = NULL;
+	}
+	file_mapping_put (map);
+	return upage;
+}
+
+/* Moves the end of the current process's heap to ADDR, allocating or
+ * freeing the pages in between.  A null ADDR only queries the end.
+ * Returns the new end of the heap, or the old one if it cannot be moved
+ * to ADDR. */
+void *
+do_brk (void *addr) {
+	struct thread *t = thread_current ();
+	struct supplemental_page_table *spt = &t->spt;
+	uint8_t *old_top = pg_round_up (t->heap_break);
+	uint8_t *new_top = pg_round_up (addr);
+
+	if (addr == NULL || (uint8_t *) addr < t->heap_start
+			|| new_top >= (uint8_t *) USER_STACK - STACK_LIMIT)
+		return t->heap_break;
+
+	if (new_top > old_top) {
+		size_t page_cnt = (new_top - old_top) / PGSIZE;
+		size_t i;
+
+		if (!range_free (old_top, page_cnt))
+			return t->heap_break;
+		for (i = 0; i < page_cnt; i++)
+			if (!vm_alloc_page (VM_ANON, old_top + i * PGSIZE, true))
+				break;
+		if (i < page_cnt) {
+			while (i-- > 0)
+				spt_remove_page (spt, spt_find_page (spt, old_top + i * PGSIZE));
+			return t->heap_break;
+		}
+	} else {
+		for (uint8_t *upage = new_top; upage < old_top; upage += PGSIZE) {
+			struct page *page = spt_find_page (spt, upage);
+			if (page != NULL)
+				spt_remove_page (spt, page);
+		}
+	}
+	t->heap_break = addr;
+	return addr;
 }
@@ -1,10 +1,19 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <round.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static bool lazy_load_file (struct page *page, void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -14,9 +23,14 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+/* Protects the reference counts of file mappings, which are shared
+ * between a parent and its forked children. */
+static struct lock mapping_lock;
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	lock_init (&mapping_lock);
 }
 
 /* Initialize the file backed page */
@@ -26,33 +40,196 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->offset = 0;
+	file_page->read_bytes = 0;
+	return true;
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	ASSERT (page->map != NULL);
+	return file_mapping_read (page->map, kva, file_page)
+		== (off_t) file_page->read_bytes;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  Only pages past
+ * the end of the file have frames of their own; the rest share the frames
+ * of the page cache, which evicts those itself.  Files never shrink, so a
+ * page past the end of the file now was past it when the file was mapped:
+ * it has no bytes of the file to write back. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	ASSERT (page->file.read_bytes == 0);
+
+	pml4_set_dirty (page->owner->pml4, page->va, false);
+	return true;
 }
 
-/* Destory the file backed page. PAGE will be freed by the caller. */
+/* Destory the file backed page. PAGE will be freed by the caller.
+ * Modified contents stay behind in the page cache, which writes them back
+ * in its own time. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (page->frame != NULL)
+		vm_free_frame (page);
+	file_mapping_put (page->map);
+	page->map = NULL;
+}
+
+/* Lazy initializer of mmap()ed pages: AUX is the malloc()ed file_page
+ * describing where the contents come from. */
+static bool
+lazy_load_file (struct page *page, void *aux) {
+	struct file_page *fp = aux;
+
+	page->file = *fp;
+	free (fp);
+	return file_backed_swap_in (page, page->frame->kva);
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	off_t file_len = file_length (file);
+	size_t i;
+
+	if (file_len == 0)
+		return NULL;
+	for (i = 0; i < page_cnt; i++)
+		if (spt_find_page (spt, addr + i * PGSIZE) != NULL)
+			return NULL;
+
+	struct file *mfile = file_reopen (file);
+	if (mfile == NULL)
+		return NULL;
+	struct file_mapping *map = file_mapping_create (mfile, addr, page_cnt);
+	if (map == NULL) {
+		file_close (mfile);
+		return NULL;
+	}
+
+	/* Bytes of the file that fall inside the mapping; the rest of the
+	 * mapping reads as zeros. */
+	size_t read_left = offset < file_len ? file_len - offset : 0;
+	if (read_left > length)
+		read_left = length;
+
+	for (i = 0; i < page_cnt; i++) {
+		struct file_page *fp = malloc (sizeof *fp);
+		if (fp == NULL)
+			break;
+		fp->offset = offset + i * PGSIZE;
+		fp->read_bytes = read_left < PGSIZE ? read_left : PGSIZE;
+		if (!vm_alloc_mapped_page (VM_FILE, addr + i * PGSIZE, writable,
+					lazy_load_file, fp, map)) {
+			free (fp);
+			break;
+		}
+		read_left -= fp->read_bytes;
+	}
+
+	if (i < page_cnt) {
+		/* Roll back the pages that made it in. */
+		while (i-- > 0)
+			spt_remove_page (spt, spt_find_page (spt, addr + i * PGSIZE));
+		file_mapping_put (map);
+		return NULL;
+	}
+	file_mapping_put (map);
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page = spt_find_page (spt, addr);
+
+	if (page == NULL || page->map == NULL || page->map->start != addr)
+		return;
+	/* Program segments cannot be unmapped. */
+	if (page_get_type (page) != VM_FILE && page->map->file != NULL)
+		return;
+
+	/* The mapping may be freed along with its last page.  Unmap the whole
+	 * run in one pass over the page table first; the dirty bits stay for
+	 * the pages to hand on as they go.  If that runs out of memory, the
+	 * pages are still unmapped one at a time as they are removed. */
+	struct file_mapping *map = page->map;
+	size_t page_cnt = map->page_cnt;
+	pml4_clear_range (thread_current ()->pml4, addr, page_cnt);
+	for (size_t i = 0; i < page_cnt; i++) {
+		page = spt_find_page (spt, addr + i * PGSIZE);
+		if (page != NULL && page->map == map)
+			spt_remove_page (spt, page);
+	}
+}
+
+/* Creates a mapping of PAGE_CNT pages at START read from FILE, which the
+ * mapping takes ownership of.  The caller holds the initial reference and
+ * must drop it with file_mapping_put() once the pages are set up. */
+struct file_mapping *
+file_mapping_create (struct file *file, void *start, size_t page_cnt) {
+	struct file_mapping *map = malloc (sizeof *map);
+	if (map == NULL)
+		return NULL;
+
+	map->file = file;
+	map->start = start;
+	map->page_cnt = page_cnt;
+	map->ref_cnt = 1;
+	map->ra_next = start;
+	map->ra_window = 0;
+	map->advice = MADV_NORMAL;
+	return map;
+}
+
+/* Takes a new reference to MAP, which may be null. */
+struct file_mapping *
+file_mapping_get (struct file_mapping *map) {
+	if (map != NULL) {
+		lock_acquire (&mapping_lock);
+		map->ref_cnt++;
+		lock_release (&mapping_lock);
+	}
+	return map;
+}
+
+/* Drops a reference to MAP, which may be null, closing its file when it was
+ * the last one. */
+void
+file_mapping_put (struct file_mapping *map) {
+	if (map == NULL)
+		return;
+
+	lock_acquire (&mapping_lock);
+	bool last = --map->ref_cnt == 0;
+	lock_release (&mapping_lock);
+
+	if (last && map->file == NULL)
+		free (map);
+	else if (last) {
+		file_close (map->file);
+		free (map);
+	}
+}
+
+/* Reads the page described by FP from MAP's file into KVA and zeroes the
+ * remainder of the page.  Returns the number of bytes read. */
+off_t
+file_mapping_read (struct file_mapping *map, void *kva,
+		const struct file_page *fp) {
+	off_t bytes_read = 0;
+
+	if (fp->read_bytes > 0)
+		bytes_read = file_read_at (map->file, kva, fp->read_bytes,
+				fp->offset);
+	memset (kva + fp->read_bytes, 0, PGSIZE - fp->read_bytes);
+	return bytes_read;
 }
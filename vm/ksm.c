@@ -0,0 +1,161 @@
+/* ksm.c: Kernel same-page merging.
+ *
+ * Forked children and processes running the same program often hold many
+ * byte-identical anonymous pages.  The "ksmd" thread scans the frame table
+ * a few frames at a time, indexes anonymous frames by a checksum of their
+ * contents, and when two frames turn out to be identical maps all of their
+ * pages to one of them, read-only, and frees the other.  A write to a
+ * merged page faults and gives the writer a private copy again (see
+ * vm_break_cow() in vm.c).
+ *
+ * A frame is only indexed once its checksum has not changed between two
+ * scans, so that pages being written to are not merged just to be copied
+ * again right away.  The index holds one frame per checksum; a match is
+ * always confirmed by comparing the whole page with both frames mapped
+ * read-only. */
+
+#include "vm/ksm.h"
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/text.h"
+#include "vm/vm.h"
+
+/* Ticks that ksmd sleeps between two batches of scanning. */
+#define KSM_SLEEP_TICKS (TIMER_FREQ / 10)
+
+/* Default batch size, in frames. */
+#define KSM_DEFAULT_PAGES 32
+
+size_t ksm_pages_to_scan = KSM_DEFAULT_PAGES;
+
+/* Stable anonymous frames by checksum.  Protected by FRAME_LOCK, as are
+ * the KSM members of the frames. */
+static struct hash ksm_index;
+
+/* Statistics. */
+static long long scan_cnt;            /* Frames scanned. */
+static long long merge_cnt;           /* Pages merged into another frame. */
+static long long unmerge_cnt;         /* Merged pages copied on write. */
+
+static void ksmd (void *aux);
+static void ksm_scan_frame (struct frame *frame);
+
+/* Returns the checksum of frame F as its hash. */
+static uint64_t
+ksm_hash (const struct hash_elem *f_, void *aux UNUSED) {
+	const struct frame *f = hash_entry (f_, struct frame, ksm_elem);
+	return f->ksm_sum;
+}
+
+/* Orders frames A and B by checksum. */
+static bool
+ksm_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, ksm_elem);
+	const struct frame *b = hash_entry (b_, struct frame, ksm_elem);
+	return a->ksm_sum < b->ksm_sum;
+}
+
+/* Starts the merging thread, unless disabled on the command line. */
+void
+ksm_init (void) {
+	hash_init (&ksm_index, ksm_hash, ksm_less, NULL);
+	if (ksm_pages_to_scan > 0)
+		thread_create ("ksmd", PRI_DEFAULT, ksmd, NULL);
+}
+
+/* Drops FRAME from the index, e.g. because it is leaving the frame table.
+ * FRAME_LOCK must be held. */
+void
+ksm_forget (struct frame *frame) {
+	if (frame->ksm_indexed) {
+		hash_delete (&ksm_index, &frame->ksm_elem);
+		frame->ksm_indexed = false;
+	}
+}
+
+/* Counts a merged page that got its own copy back. */
+void
+ksm_count_unmerge (void) {
+	unmerge_cnt++;
+}
+
+/* Prints merging statistics. */
+void
+ksm_print_stats (void) {
+	printf ("KSM: %lld frames scanned, %lld pages merged, %lld unmerged\n",
+			scan_cnt, merge_cnt, unmerge_cnt);
+}
+
+/* Scans KSM_PAGES_TO_SCAN frames every KSM_SLEEP_TICKS.  The frame lock is
+ * dropped between frames so that faults are not held up by a batch. */
+static void
+ksmd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (KSM_SLEEP_TICKS);
+		for (size_t i = 0; i < ksm_pages_to_scan; i++) {
+			lock_acquire (&frame_lock);
+			struct frame *frame = vm_frame_scan_next ();
+			if (frame != NULL)
+				ksm_scan_frame (frame);
+			lock_release (&frame_lock);
+			if (frame == NULL)
+				break;
+		}
+		text_reap ();
+	}
+}
+
+/* Indexes FRAME, or merges it into an identical frame in the index.
+ * FRAME_LOCK must be held. */
+static void
+ksm_scan_frame (struct frame *frame) {
+	/* Cached program text stays as it is: merging other pages into it
+	 * would keep it alive without the executable, and frames of the page
+	 * cache are shared already.  Merging a page of a huge page would split
+	 * it. */
+	if (frame->pin_cnt > 0 || frame->text != NULL || frame->cache_inode != NULL
+			|| VM_TYPE (frame->page->operations->type) != VM_ANON
+			|| pml4_is_huge (frame->page->owner->pml4, frame->page->va))
+		return;
+
+	scan_cnt++;
+	uint64_t sum = hash_bytes (frame->kva, PGSIZE);
+	if (frame->ksm_indexed && sum == frame->ksm_sum)
+		return;
+
+	ksm_forget (frame);
+	bool stable = sum == frame->ksm_sum;
+	frame->ksm_sum = sum;
+	if (!stable)
+		return;
+
+	struct hash_elem *e = hash_find (&ksm_index, &frame->ksm_elem);
+	if (e == NULL) {
+		hash_insert (&ksm_index, &frame->ksm_elem);
+		frame->ksm_indexed = true;
+		return;
+	}
+
+	struct frame *match = hash_entry (e, struct frame, ksm_elem);
+	if (match->pin_cnt > 0 || match->text != NULL
+			|| pml4_is_huge (match->page->owner->pml4, match->page->va))
+		return;
+
+	/* Nobody may write either frame while they are compared. */
+	bool read_only = vm_frame_protect (frame, true)
+		&& vm_frame_protect (match, true);
+	if (read_only && memcmp (frame->kva, match->kva, PGSIZE) == 0) {
+		merge_cnt += frame->page_cnt;
+		vm_frame_merge (match, frame);
+	} else {
+		vm_frame_protect (frame, false);
+		vm_frame_protect (match, false);
+	}
+}
@@ -0,0 +1,155 @@
+/* madvise.c: Paging control by user processes.
+ *
+ * madvise() tells the VM how a range of pages is going to be used:
+ * MADV_WILLNEED reads the pages in ahead of use, MADV_DONTNEED drops them
+ * right away, and MADV_RANDOM and MADV_SEQUENTIAL set the readahead
+ * policy of the file runs in the range (see vm_fault_around()).  Dropped
+ * pages of anonymous memory -- anonymous mmap()s, the heap and the stack
+ * -- lose their contents and read back as zeros; other pages are paged
+ * out, to come back as they were.  mincore() reports which pages of a
+ * range are resident, and mlock() keeps a range resident until munlock().
+ *
+ * Every call works on whole pages and fails with -1, before doing
+ * anything, unless ADDR is page-aligned and every page of the range is
+ * mapped. */
+
+#include "vm/madvise.h"
+#include <round.h>
+#include <syscall-nr.h>
+#include "filesys/page_cache.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Returns the number of pages in the range of LENGTH bytes at ADDR, or
+ * -1 if the range is not made of mapped user pages. */
+static long
+range_pages (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+	if (pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+			|| (uint64_t) addr + length < (uint64_t) addr
+			|| (length > 0 && !is_user_vaddr (addr + length - 1)))
+		return -1;
+	for (size_t i = 0; i < page_cnt; i++)
+		if (spt_find_page (spt, addr + i * PGSIZE) == NULL)
+			return -1;
+	return page_cnt;
+}
+
+/* Returns true if PAGE is anonymous memory of the current process, that
+ * started out zero-filled: part of an anonymous mmap(), of the heap or of
+ * the stack.  Loaded program segments are anonymous pages too, but their
+ * contents come from the executable. */
+static bool
+zero_fill_page (struct page *page) {
+	struct thread *t = thread_current ();
+	uint8_t *va = page->va;
+
+	if (page_get_type (page) != VM_ANON)
+		return false;
+	if (page->map != NULL)
+		return page->map->file == NULL;
+	return (va >= (uint8_t *) pg_round_up (t->heap_start)
+			&& va < (uint8_t *) pg_round_up (t->heap_break))
+		|| va >= (uint8_t *) USER_STACK - STACK_LIMIT;
+}
+
+/* Drops PAGE for MADV_DONTNEED: discards it if it is zero-filled
+ * anonymous memory, and pages it out otherwise.  A dirty file page is
+ * written back, which the evictor only does if the page cache is idle;
+ * here we can wait for it. */
+static bool
+dontneed_page (struct page *page) {
+	if (zero_fill_page (page))
+		return vm_page_discard (page);
+	if (page_get_type (page) != VM_FILE || page->frame == NULL)
+		return vm_page_out (page);
+
+	lock_acquire (&page_cache_lock);
+	bool success = vm_page_out (page);
+	lock_release (&page_cache_lock);
+	return success;
+}
+
+/* Applies ADVICE to the pages of the range of LENGTH bytes at ADDR.
+ * Returns 0 if successful, -1 on failure. */
+int
+vm_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	long page_cnt = range_pages (addr, length);
+	int ret = 0;
+
+	if (page_cnt < 0 || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return -1;
+
+	for (long i = 0; i < page_cnt; i++) {
+		struct page *page = spt_find_page (spt, addr + i * PGSIZE);
+		switch (advice) {
+			case MADV_NORMAL:
+			case MADV_RANDOM:
+			case MADV_SEQUENTIAL:
+				if (page->map != NULL && page->map->advice != advice) {
+					page->map->advice = advice;
+					page->map->ra_window = 0;
+				}
+				break;
+			case MADV_WILLNEED:
+				/* Only a hint: stop once memory runs low. */
+				if (!vm_prefetch_page (page))
+					return 0;
+				break;
+			case MADV_DONTNEED:
+				if (!dontneed_page (page))
+					ret = -1;
+				break;
+		}
+	}
+	return ret;
+}
+
+/* Stores into VEC, one byte for each page of the range of LENGTH bytes at
+ * ADDR, 1 if the page is resident and 0 if it is not.  Returns 0 if
+ * successful, -1 on failure. */
+int
+vm_mincore (void *addr, size_t length, unsigned char *vec) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	long page_cnt = range_pages (addr, length);
+
+	if (page_cnt < 0)
+		return -1;
+	for (long i = 0; i < page_cnt; i++)
+		vec[i] = spt_find_page (spt, addr + i * PGSIZE)->frame != NULL;
+	return 0;
+}
+
+/* Brings in and locks the pages of the range of LENGTH bytes at ADDR.
+ * Returns 0 if successful, -1 on failure, in which case some of the pages
+ * may be locked already. */
+int
+vm_mlock (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	long page_cnt = range_pages (addr, length);
+
+	if (page_cnt < 0)
+		return -1;
+	for (long i = 0; i < page_cnt; i++)
+		if (!vm_lock_page (spt_find_page (spt, addr + i * PGSIZE)))
+			return -1;
+	return 0;
+}
+
+/* Unlocks the pages of the range of LENGTH bytes at ADDR.  Returns 0 if
+ * successful, -1 on failure. */
+int
+vm_munlock (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	long page_cnt = range_pages (addr, length);
+
+	if (page_cnt < 0)
+		return -1;
+	for (long i = 0; i < page_cnt; i++)
+		vm_unlock_page (spt_find_page (spt, addr + i * PGSIZE));
+	return 0;
+}
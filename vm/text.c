@@ -0,0 +1,141 @@
+/* text.c: Frames of read-only program text shared between processes.
+ *
+ * The first process to fault in a page of a non-writable PT_LOAD segment
+ * registers its frame here under (inode, offset).  Every other process
+ * running the same executable then maps that frame instead of reading the
+ * page again (see vm_claim_with() in vm.c).  An entry lives as long as its
+ * frame is in the frame table, i.e. until the last process mapping it
+ * unmaps it or the frame is evicted.
+ *
+ * Each entry keeps the executable open with writes denied, so that its
+ * inode number cannot be reused and the cached contents cannot go stale.
+ * Closing a file must not be done under the frame lock, so entries that
+ * are forgotten are parked and closed later by text_reap(). */
+
+#include "vm/text.h"
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "vm/vm.h"
+
+struct text_entry {
+	struct hash_elem elem;      /* Element in TEXT_TABLE. */
+	struct list_elem dead_elem; /* Element in DEAD_ENTRIES. */
+	struct text_key key;
+	struct frame *frame;        /* Frame holding the page. */
+	struct file *file;          /* Executable, kept open and unwritable. */
+};
+
+/* Cached text frames and forgotten entries whose file is still open.
+ * Both are protected by FRAME_LOCK. */
+static struct hash text_table;
+static struct list dead_entries;
+
+/* Returns a hash value for entry E. */
+static uint64_t
+text_hash (const struct hash_elem *e_, void *aux UNUSED) {
+	const struct text_entry *e = hash_entry (e_, struct text_entry, elem);
+	return hash_bytes (&e->key, sizeof e->key);
+}
+
+/* Returns true if entry A precedes entry B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct text_key *a = &hash_entry (a_, struct text_entry, elem)->key;
+	const struct text_key *b = &hash_entry (b_, struct text_entry, elem)->key;
+
+	if (a->inumber != b->inumber)
+		return a->inumber < b->inumber;
+	if (a->offset != b->offset)
+		return a->offset < b->offset;
+	return a->read_bytes < b->read_bytes;
+}
+
+void
+text_init (void) {
+	hash_init (&text_table, text_hash, text_less, NULL);
+	list_init (&dead_entries);
+}
+
+/* Returns the frame caching the text page KEY, or NULL.  FRAME_LOCK must be
+ * held. */
+struct frame *
+text_lookup (const struct text_key *key) {
+	struct text_entry e;
+	struct hash_elem *found;
+
+	e.key = *key;
+	found = hash_find (&text_table, &e.elem);
+	return found != NULL
+		? hash_entry (found, struct text_entry, elem)->frame : NULL;
+}
+
+/* Registers FRAME as holding the text page KEY of FILE, which must come
+ * from text_open() and is owned by the entry on success.  Returns false if
+ * the page is cached already.  FRAME_LOCK must be held. */
+bool
+text_insert (struct frame *frame, const struct text_key *key,
+		struct file *file) {
+	struct text_entry *e = malloc (sizeof *e);
+	if (e == NULL)
+		return false;
+
+	e->key = *key;
+	e->frame = frame;
+	e->file = file;
+	if (hash_insert (&text_table, &e->elem) != NULL) {
+		free (e);
+		return false;
+	}
+	frame->text = e;
+	return true;
+}
+
+/* Drops the entry of FRAME, if it has one.  FRAME_LOCK must be held. */
+void
+text_forget (struct frame *frame) {
+	struct text_entry *e = frame->text;
+
+	if (e != NULL) {
+		hash_delete (&text_table, &e->elem);
+		list_push_back (&dead_entries, &e->dead_elem);
+		frame->text = NULL;
+	}
+}
+
+/* Closes the files of forgotten entries.  Must not be called with
+ * FRAME_LOCK held. */
+void
+text_reap (void) {
+	struct list dead;
+
+	list_init (&dead);
+	lock_acquire (&frame_lock);
+	while (!list_empty (&dead_entries))
+		list_push_back (&dead, list_pop_front (&dead_entries));
+	lock_release (&frame_lock);
+
+	while (!list_empty (&dead)) {
+		struct text_entry *e = list_entry (list_pop_front (&dead),
+				struct text_entry, dead_elem);
+		text_close (e->file);
+		free (e);
+	}
+}
+
+/* Returns a new handle of FILE with writes denied, for a text entry. */
+struct file *
+text_open (struct file *file) {
+	struct file *text = file_reopen (file);
+	if (text != NULL)
+		file_deny_write (text);
+	return text;
+}
+
+/* Closes a handle returned by text_open(). */
+void
+text_close (struct file *file) {
+	file_close (file);
+}
@@ -10,6 +10,9 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
 
 static bool uninit_initialize (struct page *page, void *kva);
 static void uninit_destroy (struct page *page);
@@ -51,7 +54,9 @@ uninit_initialize (struct page *page, void *kva) {
 	vm_initializer *init = uninit->init;
 	void *aux = uninit->aux;
 
-	/* TODO: You may need to fix this function. */
+	/* A page without an initializer starts out zero-filled. */
+	if (init == NULL)
+		memset (kva, 0, PGSIZE);
 	return uninit->page_initializer (page, uninit->type, kva) &&
 		(init ? init (page, aux) : true);
 }
@@ -62,7 +67,10 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+	struct uninit_page *uninit = &page->uninit;
+
+	/* The load information is owned by the page. */
+	free (uninit->aux);
+	file_mapping_put (page->map);
+	page->map = NULL;
 }
@@ -1,8 +1,72 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdint.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/text.h"
+#include "vm/vmstat.h"
+
+/* Pages mapped together on every fault in a file mapping: the aligned
+ * block of this many pages around the faulting one. */
+#define FAULT_AROUND_PAGES 4
+
+/* Bounds of the adaptive readahead window, in pages.  The window opens at
+ * RA_MIN_PAGES on the first sequential fault, doubles on every further
+ * one, and collapses back to fault-around only on a random fault. */
+#define RA_MIN_PAGES 8
+#define RA_MAX_PAGES 64
+
+/* Pages not used for this long have left their owner's working set and
+ * are evicted first. */
+#define WS_WINDOW_TICKS TIMER_FREQ
+
+/* Victims tried per eviction before giving up.  Evicting a frame of the
+ * page cache can fail when the page cache is busy, so do not insist on
+ * one. */
+#define EVICT_TRIES 8
+
+/* Most stack pages grown ahead of a single growth fault. */
+#define STACK_CHUNK_MAX 32
+
+/* Pages in a huge page. */
+#define HUGE_PAGES (HUGE_PGSIZE / PGSIZE)
+
+/* Every frame that backs a resident user page, in clock order.  FRAME_LOCK
+ * protects the table, the clock and KSM scan hands, and the frames in the
+ * table along with their links to pages; it is never held across disk
+ * I/O.  EVICT_LOCK is held for the whole of each eviction, so waiting on it
+ * waits out the eviction that is in flight. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static struct list_elem *scan_hand;
+struct lock frame_lock;
+static struct lock evict_lock;
+
+/* Free user frame watermarks.  When a frame allocation leaves fewer than
+ * VM_WM_LOW frames free, the reclaim daemon is woken up and evicts pages
+ * until VM_WM_HIGH frames are free again. */
+size_t vm_wm_low;
+size_t vm_wm_high;
+
+/* Pages mlock()ed by all processes together.  At most half of the user
+ * pool may be locked, so that eviction always has something to work
+ * with. */
+static size_t locked_cnt;
+
+static struct semaphore reclaim_sema;
+static bool reclaim_pending;
+static void reclaim_daemon (void *aux);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +79,30 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+#ifndef EFILESYS
+	pagecache_init ();
+#endif
+	list_init (&frame_table);
+	clock_hand = scan_hand = NULL;
+	lock_init (&frame_lock);
+	lock_init (&evict_lock);
+
+	size_t user_pages = palloc_user_page_cnt ();
+	if (vm_wm_low == 0)
+		vm_wm_low = user_pages / 32 > 4 ? user_pages / 32 : 4;
+	if (vm_wm_high <= vm_wm_low)
+		vm_wm_high = vm_wm_low * 2;
+	if (vm_wm_high > user_pages / 2) {
+		/* Tiny user pools: do not keep most of memory idle. */
+		vm_wm_high = user_pages / 2;
+		vm_wm_low = vm_wm_high / 2;
+	}
+
+	sema_init (&reclaim_sema, 0);
+	thread_create ("reclaimd", PRI_DEFAULT, reclaim_daemon, NULL);
+	text_init ();
+	ksm_init ();
+	vmstat_init ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -34,8 +121,21 @@ page_get_type (struct page *page) {
 
 /* Helpers */
 static struct frame *vm_get_victim (void);
+static void frame_table_remove (struct frame *frame);
+static void frame_attach (struct frame *frame, struct page *page);
+static void frame_detach (struct page *page);
+static void wait_for_eviction (struct page *page);
+static bool vm_break_cow (struct page *page);
 static bool vm_do_claim_page (struct page *page);
+static bool vm_claim_with (struct page *page,
+		struct frame *(*get_frame) (void));
+static bool vm_map_frame (struct page *page, struct frame *frame);
+static bool vm_map_cached (struct page *page,
+		struct frame *(*get_frame) (void));
 static struct frame *vm_evict_frame (void);
+static struct frame *vm_alloc_frame (void);
+static void vm_fault_around (struct page *page, struct file_mapping *map);
+static bool vm_try_huge (struct page *page);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,94 +150,904 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		struct page *page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->owner = thread_current ();
+		page->writable = writable;
+		page->map = NULL;
+		page->locked = false;
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
+/* Like vm_alloc_page_with_initializer(), but records that the contents of
+ * UPAGE come from MAP, so that a fault on it may bring in its neighbours
+ * as well.  The page takes its own reference to MAP. */
+bool
+vm_alloc_mapped_page (enum vm_type type, void *upage, bool writable,
+		vm_initializer *init, void *aux, struct file_mapping *map) {
+	if (!vm_alloc_page_with_initializer (type, upage, writable, init, aux))
+		return false;
+
+	struct page *page = spt_find_page (&thread_current ()->spt, upage);
+	page->map = file_mapping_get (map);
+	return true;
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page p;
+	struct hash_elem *e;
 
-	return page;
+	p.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &p.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt,
+		struct page *page) {
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
 	vm_dealloc_page (page);
+}
+
+/* Removes FRAME from the frame table, moving the hands past it.
+ * FRAME_LOCK must be held. */
+static void
+frame_table_remove (struct frame *frame) {
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	if (scan_hand == &frame->elem)
+		scan_hand = list_next (scan_hand);
+	ksm_forget (frame);
+	text_forget (frame);
+	list_remove (&frame->elem);
+}
+
+/* Maps FRAME at PAGE (in the bookkeeping only).  FRAME_LOCK must be held,
+ * unless FRAME is not in the frame table yet. */
+static void
+frame_attach (struct frame *frame, struct page *page) {
+	if (frame->page == NULL)
+		frame->page = page;
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->page_cnt++;
+	page->frame = frame;
+	page->owner->vm_stats.resident++;
+}
+
+/* Unlinks PAGE from its frame.  FRAME_LOCK must be held. */
+static void
+frame_detach (struct page *page) {
+	struct frame *frame = page->frame;
+
+	list_remove (&page->frame_elem);
+	frame->page_cnt--;
+	page->owner->vm_stats.resident--;
+	if (frame->page == page)
+		frame->page = frame->page_cnt > 0
+			? list_entry (list_front (&frame->pages), struct page, frame_elem)
+			: NULL;
+	page->frame = NULL;
+}
+
+/* Returns the next frame for the KSM scanner, wrapping around at the end
+ * of the table, or NULL if the table is empty.  FRAME_LOCK must be
+ * held. */
+struct frame *
+vm_frame_scan_next (void) {
+	if (scan_hand == NULL || scan_hand == list_end (&frame_table))
+		scan_hand = list_begin (&frame_table);
+	if (scan_hand == list_end (&frame_table))
+		return NULL;
+
+	struct frame *frame = list_entry (scan_hand, struct frame, elem);
+	scan_hand = list_next (scan_hand);
+	return frame;
+}
+
+/* Adds FRAME, which is not in the frame table yet, to the table.
+ * FRAME_LOCK must be held. */
+void
+vm_frame_track (struct frame *frame) {
+	list_push_back (&frame_table, &frame->elem);
+}
+
+/* Removes FRAME, which no page maps, from the frame table and frees it.
+ * FRAME_LOCK must be held. */
+void
+vm_frame_discard (struct frame *frame) {
+	ASSERT (frame->page_cnt == 0);
+
+	frame_table_remove (frame);
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Points the mapping of PAGE at KVA.  Clearing the old entry first flushes
+ * it from the TLB if PAGE's owner is the running process. */
+static void
+vm_remap (struct page *page, void *kva, bool writable) {
+	pml4_clear_page (page->owner->pml4, page->va);
+	pml4_set_page (page->owner->pml4, page->va, kva, writable);
+}
+
+/* Returns true if PAGE may be mapped writable to FRAME: only the page
+ * cache shares frames writable. */
+static bool
+frame_writable (struct frame *frame, struct page *page) {
+	return page->writable
+		&& (frame->page_cnt == 1 || frame->cache_inode != NULL);
+}
+
+/* Makes the mappings of every page of FRAME read-only if READ_ONLY, or
+ * else as writable as the page and the sharing of FRAME allow.  Returns
+ * false if a huge page had to be split for that and memory ran out, in
+ * which case some of the mappings may have been left as they were.
+ * FRAME_LOCK must be held. */
+bool
+vm_frame_protect (struct frame *frame, bool read_only) {
+	struct list_elem *e;
+	bool success = true;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (!pml4_protect_range (page->owner->pml4, page->va, 1,
+					!read_only && frame_writable (frame, page)))
+			success = false;
+	}
+	return success;
+}
+
+/* Moves the pages of SRC over to DST, which has the same contents, mapping
+ * them read-only, and frees SRC.  FRAME_LOCK must be held. */
+void
+vm_frame_merge (struct frame *dst, struct frame *src) {
+	while (!list_empty (&src->pages)) {
+		struct page *page = list_entry (list_front (&src->pages),
+				struct page, frame_elem);
+		frame_detach (page);
+		frame_attach (dst, page);
+		vm_remap (page, dst->kva, false);
+	}
+	frame_table_remove (src);
+	palloc_free_page (src->kva);
+	free (src);
+}
+
+/* Returns true if FRAME may be evicted: it is not pinned and none of the
+ * pages mapping it is locked.  FRAME_LOCK must be held. */
+static bool
+frame_evictable (struct frame *frame) {
+	struct list_elem *e;
+
+	if (frame->pin_cnt > 0)
+		return false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (list_entry (e, struct page, frame_elem)->locked)
+			return false;
+	return true;
+}
+
+/* Returns true if PAGE has been accessed since the last call, clearing its
+ * accessed bit.  All the pages of a huge mapping share the accessed bit of
+ * its page directory entry.  Their frames enter the frame table in address
+ * order and stay there until the huge page is split, so the bit is only
+ * cleared for the last page: every frame met before it is credited with an
+ * access to any part of the huge page. */
+static bool
+page_test_accessed (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+
+	if (!pml4_is_accessed (pml4, page->va))
+		return false;
+	if (!pml4_is_huge (pml4, page->va)
+			|| pg_no (page->va) % HUGE_PAGES == HUGE_PAGES - 1)
+		pml4_set_accessed (pml4, page->va, false);
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Returns true if FRAME has been used since the last call, clearing the
+ * accessed bits of the pages mapping it and the access recorded by the
+ * working-set sampler.  FRAME_LOCK must be held. */
+static bool
+frame_test_accessed (struct frame *frame) {
+	bool accessed = frame->referenced;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (page_test_accessed (list_entry (e, struct page, frame_elem)))
+			accessed = true;
+	frame->referenced = false;
+	return accessed;
+}
+
+/* Moves the accessed bits of all resident pages into their frames, for
+ * the clock to find, and counts each page found accessed in the ws_scan of
+ * its owner.  Called periodically by the working-set sampler. */
+void
+vm_sample_working_set (void) {
+	struct list_elem *e, *p;
+
+	lock_acquire (&frame_lock);
+	for (e = list_begin (&frame_table); e != list_end (&frame_table);
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, elem);
+		for (p = list_begin (&frame->pages); p != list_end (&frame->pages);
+				p = list_next (p)) {
+			struct page *page = list_entry (p, struct page, frame_elem);
+			if (page_test_accessed (page)) {
+				frame->referenced = true;
+				page->owner->vm_stats.ws_scan++;
+			}
+		}
+	}
+	lock_release (&frame_lock);
+}
+
+/* Returns the number of resident pages of the process that would lose a
+ * page if FRAME were evicted.  Frames of the page cache that no page maps
+ * cost nobody anything. */
+static size_t
+victim_resident (const struct frame *frame) {
+	return frame->page != NULL ? frame->page->owner->vm_stats.resident
+		: SIZE_MAX;
+}
+
+/* Returns true if evicting A is fairer than evicting B, both of which are
+ * in their owners' working sets: A's owner holds more resident pages, or
+ * as many and A has gone unused for longer. */
+static bool
+fairer_victim (const struct frame *a, const struct frame *b) {
+	size_t a_resident = victim_resident (a);
+	size_t b_resident = victim_resident (b);
+
+	if (a_resident != b_resident)
+		return a_resident > b_resident;
+	return a->last_use < b->last_use;
+}
+
+/* Get the struct frame, that will be evicted.
+ *
+ * Runs WSClock over the frame table.  A frame found accessed through any
+ * of its pages has its last use set to the current time and is passed
+ * over.  The first frame that has gone unused for longer than
+ * WS_WINDOW_TICKS has left its owner's working set and is the victim.  If
+ * every frame is still in a working set, the victim is chosen fairly
+ * among them: from the process with the most resident pages, so that a
+ * process streaming through a large file gives up its own pages before
+ * the working sets of others.  Pages of runs read sequentially never get
+ * a second chance.  Frames of the page cache take part like the others.
+ * FRAME_LOCK must be held. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	size_t frame_cnt = list_size (&frame_table);
+	int64_t now = timer_ticks ();
+	struct frame *fallback = NULL;
+
+	for (size_t i = 0; i < 2 * frame_cnt; i++) {
+		if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+
+		struct frame *frame = list_entry (clock_hand, struct frame, elem);
+		struct page *page = frame->page;
+		clock_hand = list_next (clock_hand);
+
+		if (!frame_evictable (frame))
+			continue;
+		if (page != NULL && page->map != NULL
+				&& page->map->advice == MADV_SEQUENTIAL)
+			return frame;
+
+		if (frame_test_accessed (frame)) {
+			frame->last_use = now;
+			continue;
+		}
+		if (now - frame->last_use > WS_WINDOW_TICKS)
+			return frame;
+		if (fallback == NULL || fairer_victim (frame, fallback))
+			fallback = frame;
+	}
+	return fallback;
+}
+
+/* Maps again the pages of VICTIM from E on, whose mappings were cleared
+ * for an eviction that failed, keeping their dirty bits.  FRAME_LOCK must
+ * be held. */
+static void
+frame_remap_from (struct frame *victim, struct list_elem *e) {
+	for (; e != list_end (&victim->pages); e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+		bool dirty = pml4_is_dirty (pml4, page->va);
+		pml4_set_page (pml4, page->va, victim->kva,
+				frame_writable (victim, page));
+		pml4_set_dirty (pml4, page->va, dirty);
+	}
+}
+
+/* Evicts VICTIM, a frame of the page cache, like vm_evict_page(): unmaps
+ * it from all the pages that map it, writes it back if it is dirty and
+ * takes it out of the cache.
+ *
+ * Frames leave the page cache under PAGE_CACHE_LOCK, which is held across
+ * the write-back so that nobody reads the page in again before it is
+ * written.  The lock comes before FRAME_LOCK, held here, so it is only
+ * tried, and VICTIM is passed over if the page cache is busy. */
+static bool
+vm_evict_cached (struct frame *victim) {
+	struct list_elem *e;
+
+	bool held = lock_held_by_current_thread (&page_cache_lock);
+	if (!held && !lock_try_acquire (&page_cache_lock))
+		return false;
+
+	/* Clearing the mappings keeps their dirty bits for the write. */
+	frame_table_remove (victim);
+	victim->evicting = true;
+	for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		pml4_clear_page (page->owner->pml4, page->va);
+	}
+	lock_release (&frame_lock);
+
+	bool success = page_cache_write_frame (victim);
+
+	lock_acquire (&frame_lock);
+	if (success) {
+		while (!list_empty (&victim->pages)) {
+			struct page *page = list_entry (list_front (&victim->pages),
+					struct page, frame_elem);
+			page->owner->vm_stats.evictions++;
+			frame_detach (page);
+		}
+		page_cache_forget (victim);
+	} else {
+		frame_remap_from (victim, list_begin (&victim->pages));
+		list_push_back (&frame_table, &victim->elem);
+	}
+	victim->evicting = false;
+	if (!held)
+		lock_release (&page_cache_lock);
+	return success;
+}
+
+/* Writes out the pages of VICTIM and unlinks them, leaving VICTIM out of
+ * the frame table for the caller to reuse or free.  Each page of a shared
+ * frame gets its own copy in swap.  If a page cannot be written out, the
+ * pages written so far stay evicted, the others are mapped again and
+ * VICTIM is put back into the table.  Frames of the page cache are left
+ * to vm_evict_cached().  EVICT_LOCK and FRAME_LOCK must be held;
+ * FRAME_LOCK is dropped during the writes. */
+static bool
+vm_evict_page (struct frame *victim) {
+	struct list_elem *e;
 
-	return victim;
+	if (victim->cache_inode != NULL)
+		return vm_evict_cached (victim);
+
+	/* Unmap the pages first so that their owners cannot change them while
+	 * they are written out.  Clearing a mapping keeps its dirty bit. */
+	frame_table_remove (victim);
+	victim->evicting = true;
+	for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		pml4_clear_page (page->owner->pml4, page->va);
+	}
+	lock_release (&frame_lock);
+
+	/* Nobody attaches pages to a frame out of the table meanwhile. */
+	e = list_begin (&victim->pages);
+	while (e != list_end (&victim->pages)
+			&& swap_out (list_entry (e, struct page, frame_elem)))
+		e = list_next (e);
+	bool success = e == list_end (&victim->pages);
+
+	lock_acquire (&frame_lock);
+	while (list_begin (&victim->pages) != e) {
+		struct page *page = list_entry (list_begin (&victim->pages),
+				struct page, frame_elem);
+		page->owner->vm_stats.evictions++;
+		frame_detach (page);
+	}
+	if (!success) {
+		frame_remap_from (victim, e);
+		list_push_back (&frame_table, &victim->elem);
+	}
+	victim->evicting = false;
+	return success;
 }
 
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *evicted = NULL;
+
+	lock_acquire (&evict_lock);
+	for (int try = 0; evicted == NULL && try < EVICT_TRIES; try++) {
+		lock_acquire (&frame_lock);
+		struct frame *victim = vm_get_victim ();
+		if (victim == NULL) {
+			lock_release (&frame_lock);
+			break;
+		}
+		if (vm_evict_page (victim))
+			evicted = victim;
+		lock_release (&frame_lock);
+	}
+	lock_release (&evict_lock);
+	text_reap ();
+	return evicted;
+}
 
-	return NULL;
+/* Waits until the frame of PAGE, if any, is no longer being evicted.
+ * FRAME_LOCK must be held; it is dropped while waiting. */
+static void
+wait_for_eviction (struct page *page) {
+	while (page->frame != NULL && page->frame->evicting) {
+		lock_release (&frame_lock);
+		lock_acquire (&evict_lock);
+		lock_release (&evict_lock);
+		lock_acquire (&frame_lock);
+	}
+}
+
+/* Initializes FRAME as an unused frame for the user page at KVA. */
+static void
+frame_init (struct frame *frame, void *kva) {
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->pin_cnt = 0;
+	frame->evicting = false;
+	list_init (&frame->pages);
+	frame->page_cnt = 0;
+	frame->ksm_sum = 0;
+	frame->ksm_indexed = false;
+	frame->text = NULL;
+	frame->referenced = false;
+	frame->last_use = timer_ticks ();
+	frame->cache_inode = NULL;
+	frame->cache_dirty = false;
+	frame->cache_loading = false;
+}
+
+/* Takes a free frame from the user pool, without evicting anything.
+ * Returns NULL if the pool is exhausted. */
+static struct frame *
+vm_alloc_frame (void) {
+	struct frame *frame = malloc (sizeof *frame);
+	if (frame == NULL)
+		return NULL;
+
+	void *kva = palloc_get_page (PAL_USER);
+	if (kva == NULL) {
+		free (frame);
+		return NULL;
+	}
+	frame_init (frame, kva);
+	return frame;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
  * space.*/
-static struct frame *
+struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	struct frame *frame = vm_alloc_frame ();
+
+	if (palloc_user_free_cnt () < vm_wm_low && !reclaim_pending) {
+		reclaim_pending = true;
+		sema_up (&reclaim_sema);
+	}
+	if (frame == NULL)
+		frame = vm_evict_frame ();
+	if (frame == NULL)
+		return NULL;
 
-	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Unmaps PAGE from its owner's page table and returns its frame to the user
+ * pool, unless other pages still share it or it belongs to the page cache.
+ * Does nothing if the page is not resident (any more) once an eviction in
+ * progress has finished with it. */
+void
+vm_free_frame (struct page *page) {
+	lock_acquire (&frame_lock);
+	wait_for_eviction (page);
+	struct frame *frame = page->frame;
+	if (frame == NULL) {
+		lock_release (&frame_lock);
+		return;
+	}
+	uint64_t *pml4 = page->owner->pml4;
+	if (pml4 != NULL) {
+		/* The page cache writes back what PAGE changed later on. */
+		if (frame->cache_inode != NULL && pml4_is_dirty (pml4, page->va))
+			frame->cache_dirty = true;
+		pml4_clear_page (pml4, page->va);
+	}
+	if (page->locked) {
+		page->locked = false;
+		locked_cnt--;
+	}
+	frame_detach (page);
+	if (frame->page_cnt > 0 || frame->cache_inode != NULL) {
+		lock_release (&frame_lock);
+		return;
+	}
+	frame_table_remove (frame);
+	lock_release (&frame_lock);
+
+	palloc_free_page (frame->kva);
+	free (frame);
+	text_reap ();
+}
+
+/* Makes PAGE resident, faulting it in if necessary, and keeps it so until
+ * vm_unpin_page().  Used while the kernel accesses the page directly, e.g.
+ * as the buffer of a system call.  Pins nest, so the frame stays put until
+ * each of them has been dropped.  The kernel does not honor read-only
+ * mappings, so a page that it is going to WRITE gets a private frame
+ * first.  Returns false if the page could not be brought in. */
+bool
+vm_pin_page (struct page *page, bool write) {
+	lock_acquire (&frame_lock);
+	for (;;) {
+		wait_for_eviction (page);
+		if (page->frame == NULL) {
+			lock_release (&frame_lock);
+			if (!vm_do_claim_page (page))
+				return false;
+		} else if (write && page->frame->page_cnt > 1
+				&& page->frame->cache_inode == NULL) {
+			lock_release (&frame_lock);
+			if (!vm_break_cow (page))
+				return false;
+		} else
+			break;
+		lock_acquire (&frame_lock);
+	}
+	page->frame->pin_cnt++;
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Drops a pin taken by vm_pin_page().  PAGE may be evicted again once no
+ * pin is left on its frame. */
+void
+vm_unpin_page (struct page *page) {
+	lock_acquire (&frame_lock);
+	if (page->frame != NULL) {
+		ASSERT (page->frame->pin_cnt > 0);
+		page->frame->pin_cnt--;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Makes PAGE resident and keeps it so, like vm_pin_page(), until
+ * vm_unlock_page() or until the page is freed.  Fails if the page cannot
+ * be brought in or too much memory is locked already. */
+bool
+vm_lock_page (struct page *page) {
+	if (!vm_pin_page (page, false))
+		return false;
+
+	lock_acquire (&frame_lock);
+	bool success = page->locked || locked_cnt < palloc_user_page_cnt () / 2;
+	if (success && !page->locked) {
+		page->locked = true;
+		locked_cnt++;
+	}
+	page->frame->pin_cnt--;
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Lets locked PAGE be evicted again. */
+void
+vm_unlock_page (struct page *page) {
+	lock_acquire (&frame_lock);
+	if (page->locked) {
+		page->locked = false;
+		locked_cnt--;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Starts bringing in PAGE ahead of use.  Like fault-around, this only
+ * takes free frames above the low watermark and never evicts anything.
+ * Returns false if PAGE is not resident afterwards. */
+bool
+vm_prefetch_page (struct page *page) {
+	lock_acquire (&frame_lock);
+	wait_for_eviction (page);
+	bool resident = page->frame != NULL;
+	lock_release (&frame_lock);
+
+	if (resident)
+		return true;
+	if (palloc_user_free_cnt () <= vm_wm_low)
+		return false;
+	return vm_claim_with (page, vm_alloc_frame);
+}
+
+/* Evicts PAGE right away and returns its frame to the user pool, writing
+ * it back to its file or to swap first, so that the next access faults it
+ * in again.  Pages that are locked or pinned cannot be paged out; pages
+ * sharing a frame with others are left alone, since paging them out would
+ * not free anything.  Returns true if PAGE is not resident afterwards, or
+ * still shares its frame. */
+bool
+vm_page_out (struct page *page) {
+	struct frame *freed = NULL;
+	bool success = true;
+
+	lock_acquire (&evict_lock);
+	lock_acquire (&frame_lock);
+	struct frame *frame = page->frame;
+	if (frame != NULL) {
+		if (page->locked || frame->pin_cnt > 0)
+			success = false;
+		else if (frame->page_cnt == 1) {
+			success = vm_evict_page (frame);
+			if (success)
+				freed = frame;
+		}
+	}
+	lock_release (&frame_lock);
+	lock_release (&evict_lock);
+
+	if (freed != NULL) {
+		palloc_free_page (freed->kva);
+		free (freed);
+	}
+	text_reap ();
+	return success;
+}
+
+/* Drops the contents of PAGE, an anonymous page, wherever they are: its
+ * frame goes back to the user pool unless other pages share it, and its
+ * copy in swap is freed, so that the next access faults in a zeroed page.
+ * Locked pages are left alone.  Returns true if PAGE was dropped, or was
+ * never touched in the first place. */
+bool
+vm_page_discard (struct page *page) {
+	ASSERT (page_get_type (page) == VM_ANON);
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return true;
+	if (page->locked)
+		return false;
+
+	/* Once the frame is gone, eviction cannot touch the page any more. */
+	vm_free_frame (page);
+	anon_discard (page);
+	return true;
+}
+
+/* Keeps VM_WM_LOW frames free in the background, so that page faults rarely
+ * have to evict a page (and wait for its write) themselves.  Woken up by
+ * vm_get_frame() when free frames run low, it evicts pages until VM_WM_HIGH
+ * frames are free or nothing more can be evicted. */
+static void
+reclaim_daemon (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&reclaim_sema);
+		reclaim_pending = false;
+
+		while (palloc_user_free_cnt () < vm_wm_high) {
+			struct frame *frame = vm_evict_frame ();
+			if (frame == NULL)
+				break;
+			palloc_free_page (frame->kva);
+			free (frame);
+		}
+	}
+}
+
+/* Adds UPAGE to the stack ahead of use, bringing it in if free frames
+ * above the low watermark allow.  Returns false if UPAGE is mapped
+ * already. */
+static bool
+vm_stack_grow_ahead (uint8_t *upage) {
+	struct thread *t = thread_current ();
+
+	/* VM_MARKER_0 marks the page as part of the stack. */
+	if (!vm_alloc_page (VM_ANON | VM_MARKER_0, upage, true))
+		return false;
+	if (vm_prefetch_page (spt_find_page (&t->spt, upage)))
+		t->vm_stats.stack_prefaults++;
+	return true;
+}
+
+/* Growing the stack.
+ *
+ * A stack that grows a page per fault traps over and over, so the stack
+ * grows by more than the page at ADDR.  The pages between ADDR and the
+ * lowest page of the stack so far, which a large stack frame skipped, join
+ * the stack at once.  Below ADDR, a chunk of pages is grown ahead of use:
+ * as many as that frame skipped, or, for a stack that grows a page at a
+ * time, twice as many as last time, up to STACK_CHUNK_MAX.  Growth ahead
+ * stops short of the stack limit, when free frames run low, and a page
+ * before any other mapping, so that the stack never grows right up against
+ * it. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_stack_growth (void *addr) {
+	struct thread *t = thread_current ();
+	uint8_t *upage = pg_round_down (addr);
+	uint8_t *limit = (uint8_t *) USER_STACK - STACK_LIMIT;
+	uint8_t *p;
+
+	/* VM_MARKER_0 marks the page as part of the stack. */
+	if (!vm_alloc_page (VM_ANON | VM_MARKER_0, upage, true)
+			|| !vm_claim_page (upage))
+		return;
+	t->vm_stats.stack_faults++;
+	if (upage >= t->stack_bottom)
+		return;
+
+	size_t skipped = 0;
+	for (p = upage + PGSIZE; p < t->stack_bottom; p += PGSIZE)
+		if (vm_stack_grow_ahead (p))
+			skipped++;
+	if (skipped > 0)
+		t->stack_chunk = skipped;
+	else
+		t->stack_chunk = t->stack_chunk == 0 ? 1 : t->stack_chunk * 2;
+	if (t->stack_chunk > STACK_CHUNK_MAX)
+		t->stack_chunk = STACK_CHUNK_MAX;
+
+	t->stack_bottom = upage;
+	for (size_t i = 0; i < t->stack_chunk; i++) {
+		p = t->stack_bottom - PGSIZE;
+		if (p - PGSIZE < limit || palloc_user_free_cnt () <= vm_wm_low
+				|| spt_find_page (&t->spt, p - PGSIZE) != NULL
+				|| !vm_stack_grow_ahead (p))
+			break;
+		t->stack_bottom = p;
+	}
+}
+
+/* Returns true if PAGE shares a frame that must be copied before PAGE is
+ * written: only the page cache shares frames writable.  FRAME_LOCK must be
+ * held. */
+static bool
+frame_is_cow (struct page *page) {
+	return page->frame != NULL && page->frame->page_cnt > 1
+		&& page->frame->cache_inode == NULL;
+}
+
+/* Gives PAGE, which has been merged with other pages, a private copy of
+ * its frame and maps it writable.  Returns false if memory ran out. */
+static bool
+vm_break_cow (struct page *page) {
+	struct frame *copy = NULL;
+
+	lock_acquire (&frame_lock);
+	wait_for_eviction (page);
+	if (frame_is_cow (page)) {
+		lock_release (&frame_lock);
+		copy = vm_get_frame ();
+		if (copy == NULL)
+			return false;
+		lock_acquire (&frame_lock);
+		wait_for_eviction (page);
+	}
+
+	/* The frame may have changed hands while we were allocating. */
+	struct frame *frame = page->frame;
+	if (frame_is_cow (page) && copy != NULL) {
+		memcpy (copy->kva, frame->kva, PGSIZE);
+		frame_detach (page);
+		frame_attach (copy, page);
+		vm_remap (page, copy->kva, page->writable);
+		list_push_back (&frame_table, &copy->elem);
+		copy = NULL;
+		ksm_count_unmerge ();
+		page->owner->vm_stats.cow_faults++;
+	} else if (page->frame != NULL) {
+		/* Nothing to copy any more.  Should a huge page fail to split,
+		 * the write faults again and we retry. */
+		vm_frame_protect (page->frame, false);
+	}
+	lock_release (&frame_lock);
+
+	if (copy != NULL) {
+		palloc_free_page (copy->kva);
+		free (copy);
+	}
+	return true;
 }
 
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	if (!page->writable)
+		return false;
+	return vm_break_cow (page);
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
 
-	return vm_do_claim_page (page);
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (!not_present)
+		return page != NULL && vm_handle_wp (page);
+
+	if (page == NULL) {
+		/* Faults inside a system call see the kernel stack in F, so use
+		 * the user rsp saved on entry to the call instead. */
+		uintptr_t rsp = user ? f->rsp : thread_current ()->user_rsp;
+		if ((uintptr_t) addr >= rsp - 8
+				&& (uintptr_t) addr >= USER_STACK - STACK_LIMIT
+				&& (uintptr_t) addr < USER_STACK) {
+			vm_stack_growth (addr);
+			page = spt_find_page (spt, addr);
+			return page != NULL && page->frame != NULL;
+		}
+		return false;
+	}
+	if (write && !page->writable)
+		return false;
+
+	/* Lazily loaded anonymous pages forget their mapping once loaded, so
+	 * keep it alive until the neighbours have been brought in. */
+	struct vm_stats *st = &thread_current ()->vm_stats;
+	size_t disk_reads = st->disk_reads;
+	struct file_mapping *map = file_mapping_get (page->map);
+	bool success = vm_try_huge (page) || vm_do_claim_page (page);
+	if (success && st->disk_reads != disk_reads)
+		st->major_faults++;
+	else if (success)
+		st->minor_faults++;
+	if (success && map != NULL && map->file != NULL)
+		vm_fault_around (page, map);
+	file_mapping_put (map);
+	return success;
 }
 
 /* Free the page.
@@ -150,9 +1060,10 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+	if (page == NULL)
+		return false;
 
 	return vm_do_claim_page (page);
 }
@@ -160,31 +1071,391 @@ vm_claim_page (void *va UNUSED) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	/* The page may be on its way out, or already back in after a failed
+	 * eviction. */
+	lock_acquire (&frame_lock);
+	wait_for_eviction (page);
+	bool resident = page->frame != NULL;
+	if (resident && pml4_get_page (page->owner->pml4, page->va) == NULL) {
+		/* Unmapped along with the rest of a huge page that could not be
+		 * split. */
+		pml4_set_page (page->owner->pml4, page->va, page->frame->kva,
+				frame_writable (page->frame, page));
+	}
+	lock_release (&frame_lock);
+	if (resident)
+		return true;
+
+	return vm_claim_with (page, vm_get_frame);
+}
+
+/* Returns the file mapping of PAGE if it is a not-yet-loaded page of
+ * read-only program text, filling in KEY, or NULL otherwise. */
+static struct file_mapping *
+text_page_key (struct page *page, struct text_key *key) {
+	if (VM_TYPE (page->operations->type) != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON
+			|| page->writable || page->map == NULL
+			|| page->uninit.aux == NULL)
+		return NULL;
+
+	const struct file_page *fp = page->uninit.aux;
+	key->inumber = inode_get_inumber (file_get_inode (page->map->file));
+	key->offset = fp->offset;
+	key->read_bytes = fp->read_bytes;
+	return page->map;
+}
+
+/* Maps PAGE to the frame that caches the text page KEY, if there is one,
+ * instead of loading it. */
+static bool
+vm_share_text (struct page *page, const struct text_key *key) {
+	lock_acquire (&frame_lock);
+	struct frame *frame = text_lookup (key);
+	if (frame == NULL
+			|| !pml4_set_page (page->owner->pml4, page->va, frame->kva, false)) {
+		lock_release (&frame_lock);
+		return false;
+	}
+
+	/* Turn the page into what loading it would have made of it. */
+	void *aux = page->uninit.aux;
+	struct file_mapping *map = page->map;
+	page->uninit.page_initializer (page, page->uninit.type, frame->kva);
+	page->map = NULL;
+	frame_attach (frame, page);
+	lock_release (&frame_lock);
+
+	free (aux);
+	file_mapping_put (map);
+	return true;
+}
+
+/* Brings PAGE in using a frame from GET_FRAME, or by sharing the frame of
+ * another process if PAGE is program text that is already resident. */
+static bool
+vm_claim_with (struct page *page, struct frame *(*get_frame) (void)) {
+	struct text_key key;
+	struct file_mapping *map = text_page_key (page, &key);
+
+	if (page_get_type (page) == VM_FILE)
+		return vm_map_cached (page, get_frame);
+
+	if (map != NULL && vm_share_text (page, &key))
+		return true;
 
+	struct frame *frame = get_frame ();
+	if (frame == NULL)
+		return false;
+	if (map == NULL)
+		return vm_map_frame (page, frame);
+
+	/* Loading drops the page's reference to MAP. */
+	struct file *file = text_open (file_mapping_get (map)->file);
+	bool success = vm_map_frame (page, frame);
+	file_mapping_put (map);
+	if (success && file != NULL) {
+		lock_acquire (&frame_lock);
+		bool cached = page->frame == frame && text_insert (frame, &key, file);
+		lock_release (&frame_lock);
+		if (!cached)
+			text_close (file);
+	} else if (file != NULL)
+		text_close (file);
+	return success;
+}
+
+/* Links PAGE with FRAME, maps it into the owner's page table and fills it
+ * in.  The frame is kept pinned until its contents are valid. */
+static bool
+vm_map_frame (struct page *page, struct frame *frame) {
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	lock_acquire (&frame_lock);
+	frame_attach (frame, page);
+	frame->pin_cnt++;
+	list_push_back (&frame_table, &frame->elem);
+	lock_release (&frame_lock);
+
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)
+			|| !swap_in (page, frame->kva)) {
+		vm_free_frame (page);
+		return false;
+	}
+	vm_unpin_page (page);
+	return true;
+}
+
+/* Brings in PAGE, a page of an mmap()ed file, by mapping the frame of the
+ * page cache that holds its part of the file, read into a frame from
+ * GET_FRAME if it is not cached yet.  All processes that map the same part
+ * of the file share that frame, which is also the one that read() and
+ * write() go through; its changes are written back by the page cache.
+ * Pages past the end of the file get zeroed frames of their own. */
+static bool
+vm_map_cached (struct page *page, struct frame *(*get_frame) (void)) {
+	struct inode *inode = file_get_inode (page->map->file);
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		/* Turn the page into what loading it would have made of it. */
+		void *aux = page->uninit.aux;
+		page->uninit.page_initializer (page, page->uninit.type, NULL);
+		page->file = *(struct file_page *) aux;
+		free (aux);
+	}
+
+	inode_lock_shared (inode);
+	if (page->file.offset >= inode_length (inode)) {
+		inode_unlock_shared (inode);
+		struct frame *frame = get_frame ();
+		return frame != NULL && vm_map_frame (page, frame);
+	}
+
+	struct frame *frame = page_cache_get (inode, page->file.offset, get_frame);
+	inode_unlock_shared (inode);
+	bool success = frame != NULL;
+	if (success) {
+		lock_acquire (&frame_lock);
+		frame_attach (frame, page);
+		success = pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable);
+		lock_release (&frame_lock);
+		page_cache_put (frame, false);
+		if (!success)
+			vm_free_frame (page);
+	}
+	return success;
+}
+
+/* Brings in the not-yet-resident pages of MAP around PAGE, which has just
+ * been faulted in.
+ *
+ * Every fault maps the aligned block of FAULT_AROUND_PAGES pages that
+ * contains PAGE.  If the fault landed where a sequential reader would fault
+ * next, the readahead window grows and that many pages after PAGE are read
+ * as well; otherwise the window collapses.  madvise() can turn all of this
+ * off for a run (MADV_RANDOM) or keep the window wide open for it
+ * (MADV_SEQUENTIAL).  Only free frames above the low watermark are used:
+ * we never evict a page to speculatively load another one. */
+static void
+vm_fault_around (struct page *page, struct file_mapping *map) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	size_t idx = pg_no (page->va) - pg_no (map->start);
+	size_t lo = idx & ~(size_t) (FAULT_AROUND_PAGES - 1);
+	size_t hi = lo + FAULT_AROUND_PAGES;
+
+	if (map->advice == MADV_RANDOM)
+		return;
+	if (map->advice == MADV_SEQUENTIAL)
+		map->ra_window = RA_MAX_PAGES;
+	else if (page->va == map->ra_next) {
+		map->ra_window = map->ra_window == 0 ? RA_MIN_PAGES
+			: map->ra_window * 2;
+		if (map->ra_window > RA_MAX_PAGES)
+			map->ra_window = RA_MAX_PAGES;
+	} else
+		map->ra_window = 0;
+
+	if (hi < idx + 1 + map->ra_window)
+		hi = idx + 1 + map->ra_window;
+	if (hi > map->page_cnt)
+		hi = map->page_cnt;
+	map->ra_next = map->start + hi * PGSIZE;
+
+	for (size_t i = lo; i < hi; i++) {
+		struct page *p = spt_find_page (spt, map->start + i * PGSIZE);
+		if (p == NULL || p->map != map || p->frame != NULL)
+			continue;
+		if (palloc_user_free_cnt () <= vm_wm_low)
+			break;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+		if (!vm_claim_with (p, vm_alloc_frame))
+			break;
+	}
+}
+
+/* Returns true if PAGE, whose neighbour in the same huge page is about to
+ * be faulted in with WRITABLE access, could be part of a huge page: it must
+ * be an untouched anonymous page that starts out zeroed. */
+static bool
+huge_candidate (struct page *page, bool writable) {
+	if (page == NULL || page->frame != NULL || page->writable != writable
+			|| VM_TYPE (page->operations->type) != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON)
+		return false;
+	if (page->uninit.init == NULL)
+		return true;
+
+	/* Zero-filled part of a program segment, like .bss. */
+	const struct file_page *fp = page->uninit.aux;
+	return page->map != NULL && fp != NULL && fp->read_bytes == 0;
+}
+
+/* Backs the whole aligned 2 MB range around PAGE, which has just faulted,
+ * by a single huge page if every page of it is a huge_candidate() and the
+ * user pool has that much aligned memory to spare above the high
+ * watermark.  Every page still gets a frame of its own; mmu.c splits the
+ * huge mapping again as soon as one of them is unmapped or remapped on its
+ * own. */
+static bool
+vm_try_huge (struct page *page) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	void *base = (void *) ((uint64_t) page->va & ~HUGE_PGMASK);
+	bool writable = page->writable;
+	bool failed = false;
+	size_t i, cnt;
+
+	if (!writable || palloc_user_free_cnt () < HUGE_PAGES + vm_wm_high
+			|| !huge_candidate (spt_find_page (spt, base), writable)
+			|| !huge_candidate (spt_find_page (spt,
+					base + HUGE_PGSIZE - PGSIZE), writable))
+		return false;
+	for (i = 0; i < HUGE_PAGES; i++)
+		if (!huge_candidate (spt_find_page (spt, base + i * PGSIZE), writable))
+			return false;
 
-	return swap_in (page, frame->kva);
+	uint8_t *kva = palloc_get_aligned (PAL_USER, HUGE_PAGES, HUGE_PAGES);
+	if (kva == NULL)
+		return false;
+
+	/* Set up the pages one by one, then map them all at once. */
+	for (cnt = 0; cnt < HUGE_PAGES; cnt++) {
+		struct page *p = spt_find_page (spt, base + cnt * PGSIZE);
+		struct frame *frame = malloc (sizeof *frame);
+		if (frame == NULL)
+			break;
+		frame_init (frame, kva + cnt * PGSIZE);
+
+		lock_acquire (&frame_lock);
+		frame_attach (frame, p);
+		frame->pin_cnt++;
+		list_push_back (&frame_table, &frame->elem);
+		lock_release (&frame_lock);
+		if (!swap_in (p, frame->kva)) {
+			vm_free_frame (p);
+			failed = true;
+			break;
+		}
+	}
+
+	bool huge = cnt == HUGE_PAGES
+		&& pml4_set_huge_page (page->owner->pml4, base, kva, writable);
+	for (i = 0; i < cnt; i++) {
+		struct page *p = spt_find_page (spt, base + i * PGSIZE);
+		if (!huge) {
+			/* Fall back to mapping the pages set up so far one by one. */
+			pml4_set_page (p->owner->pml4, p->va, p->frame->kva,
+					p->writable);
+		}
+		vm_unpin_page (p);
+	}
+	if (cnt < HUGE_PAGES)
+		palloc_free_multiple (kva + (cnt + failed) * PGSIZE,
+				HUGE_PAGES - cnt - failed);
+	return page->frame != NULL;
+}
+
+/* Returns a hash value for page P. */
+static uint64_t
+page_hash (const struct hash_elem *p_, void *aux UNUSED) {
+	const struct page *p = hash_entry (p_, struct page, spt_elem);
+	return hash_bytes (&p->va, sizeof p->va);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page *a = hash_entry (a_, struct page, spt_elem);
+	const struct page *b = hash_entry (b_, struct page, spt_elem);
+	return a->va < b->va;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	hash_init (&spt->pages, page_hash, page_less, NULL);
+}
+
+/* Copies SRC, a page of the parent, into the current thread's SPT. */
+static bool
+spt_copy_page (struct page *src) {
+	enum vm_type type = page_get_type (src);
+	struct page *dst;
+
+	if (VM_TYPE (src->operations->type) == VM_UNINIT) {
+		/* Not touched yet: share the source, duplicate the load info. */
+		void *aux = src->uninit.aux;
+		if (aux != NULL) {
+			aux = malloc (sizeof (struct file_page));
+			if (aux == NULL)
+				return false;
+			memcpy (aux, src->uninit.aux, sizeof (struct file_page));
+		}
+		if (!vm_alloc_mapped_page (src->uninit.type, src->va, src->writable,
+					src->uninit.init, aux, src->map)) {
+			free (aux);
+			return false;
+		}
+		return true;
+	}
+
+	if (type == VM_FILE) {
+		/* Mapped from the page cache: the child maps the same frame. */
+		struct file_page *fp = malloc (sizeof *fp);
+		if (fp == NULL)
+			return false;
+		*fp = src->file;
+		if (!vm_alloc_mapped_page (VM_FILE, src->va, src->writable, NULL, fp,
+					src->map)) {
+			free (fp);
+			return false;
+		}
+		return true;
+	}
+
+	/* The parent's page may be swapped out; bring it back for the copy and
+	 * keep both pages in memory until it is done. */
+	if (!vm_alloc_mapped_page (type, src->va, src->writable, NULL, NULL,
+				src->map))
+		return false;
+	dst = spt_find_page (&thread_current ()->spt, src->va);
+	if (!vm_pin_page (src, false))
+		return false;
+	if (!vm_pin_page (dst, true)) {
+		vm_unpin_page (src);
+		return false;
+	}
+
+	memcpy (dst->frame->kva, src->frame->kva, PGSIZE);
+	vm_unpin_page (dst);
+	vm_unpin_page (src);
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+
+	hash_first (&i, &src->pages);
+	while (hash_next (&i))
+		if (!spt_copy_page (hash_entry (hash_cur (&i), struct page, spt_elem)))
+			return false;
+	return true;
+}
+
+/* Destroys the page behind hash element E. */
+static void
+spt_destroy_page (struct hash_elem *e, void *aux UNUSED) {
+	vm_dealloc_page (hash_entry (e, struct page, spt_elem));
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	/* Destroy every page; file-backed pages leave their modified contents
+	 * to the page cache on the way out. */
+	hash_destroy (&spt->pages, spt_destroy_page);
 }
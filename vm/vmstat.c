@@ -0,0 +1,68 @@
+/* vmstat.c: Per-process paging statistics.
+ *
+ * The fault handler, the evictor and the copy-on-write code count events
+ * in the struct vm_stats of the process concerned.  With -vmstat, the
+ * "wssd" thread also samples working sets: every WSS_SAMPLE_TICKS it
+ * collects the accessed bits of all resident pages (see
+ * vm_sample_working_set()), and the number of pages that each process
+ * touched since the last sample becomes its working-set size.  The
+ * statistics are printed when a process exits. */
+
+#include "vm/vmstat.h"
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Length of a working-set sampling period. */
+#define WSS_SAMPLE_TICKS (TIMER_FREQ / 4)
+
+bool vmstat_enabled;
+
+/* Publishes the working set that T was seen to use in the period that
+ * just ended. */
+static void
+wss_publish (struct thread *t, void *aux UNUSED) {
+	struct vm_stats *st = &t->vm_stats;
+
+	st->wss = st->ws_scan;
+	if (st->wss_peak < st->wss)
+		st->wss_peak = st->wss;
+	st->ws_scan = 0;
+}
+
+/* Samples the working sets of all processes, forever. */
+static void
+wss_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (WSS_SAMPLE_TICKS);
+		vm_sample_working_set ();
+
+		enum intr_level old_level = intr_disable ();
+		thread_foreach (wss_publish, NULL);
+		intr_set_level (old_level);
+	}
+}
+
+/* Starts sampling working sets if -vmstat was given. */
+void
+vmstat_init (void) {
+	if (vmstat_enabled)
+		thread_create ("wssd", PRI_DEFAULT, wss_daemon, NULL);
+}
+
+/* Prints the statistics of process T, which is exiting, if -vmstat was
+ * given. */
+void
+vmstat_print (struct thread *t) {
+	const struct vm_stats *st = &t->vm_stats;
+
+	if (!vmstat_enabled)
+		return;
+	printf ("%s: vmstat: %zu minor, %zu major, %zu cow, %zu stack faults "
+			"(%zu avoided), %zu evictions, wss %zu (peak %zu) pages\n",
+			t->name, st->minor_faults, st->major_faults, st->cow_faults,
+			st->stack_faults, st->stack_prefaults, st->evictions, st->wss,
+			st->wss_peak);
+}
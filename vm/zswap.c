@@ -0,0 +1,264 @@
+/* zswap.c: Compressed in-memory tier in front of the swap disk.
+ *
+ * Evicted anonymous pages are compressed into an arena of kernel pages and
+ * decompressed from there when they fault back in.  Only when the arena is
+ * full, or a page does not compress well, does it go to the swap disk,
+ * where writing it costs eight PIO sector writes.
+ *
+ * The compressor is a small LZ77 variant in the style of LZRW1: items are
+ * grouped by eight behind a control byte whose bits tell literals (one
+ * byte) from matches (two bytes: a 12-bit backwards offset and a 4-bit
+ * length of 3 to 18 bytes).  Matches are found through a hash table of the
+ * last position of every 3-byte prefix, so compression is a single pass. */
+
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Default arena size, in pages. */
+#define ZSWAP_DEFAULT_PAGES 256
+
+/* Allocation unit of the arena. */
+#define ZSWAP_CHUNK 64
+
+/* Pages that do not shrink below this size go to disk instead. */
+#define ZSWAP_MAX_SIZE (PGSIZE - PGSIZE / 4)
+
+/* Marks a page of zeros, which takes no space in the arena. */
+#define ZSWAP_ZERO (BITMAP_ERROR - 1)
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15)
+#define LZ_MAX_OFFSET 4095
+#define LZ_HASH_BITS 12
+
+size_t zswap_pages = ZSWAP_DEFAULT_PAGES;
+
+/* The arena, and one bit per chunk of it that is in use.  ZSWAP_LOCK
+ * protects both, the scratch buffers and the statistics. */
+static uint8_t *arena;
+static struct bitmap *chunk_map;
+static struct lock zswap_lock;
+
+/* Scratch space of the compressor. */
+static uint8_t *scratch;
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+/* Statistics. */
+static long long store_cnt;           /* Pages offered for storing. */
+static long long stored_cnt;          /* Pages stored in the arena. */
+static long long zero_cnt;            /* ...of which were all zeros. */
+static long long stored_bytes;        /* Compressed size of those. */
+static long long load_cnt;            /* Pages swapped back in. */
+static long long hit_cnt;             /* ...of which came from the arena. */
+
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t cap);
+static void lz_decompress (const uint8_t *src, uint8_t *dst);
+
+/* Sets up an arena of ZSWAP_PAGES kernel pages, or a smaller one if the
+ * kernel pool cannot spare that many. */
+void
+zswap_init (void) {
+	lock_init (&zswap_lock);
+	if (zswap_pages == 0)
+		return;
+
+	scratch = palloc_get_page (0);
+	if (scratch == NULL)
+		return;
+	for (; zswap_pages > 0; zswap_pages /= 2) {
+		arena = palloc_get_multiple (0, zswap_pages);
+		if (arena != NULL)
+			break;
+	}
+	if (arena == NULL)
+		return;
+
+	chunk_map = bitmap_create (zswap_pages * PGSIZE / ZSWAP_CHUNK);
+	if (chunk_map == NULL) {
+		palloc_free_multiple (arena, zswap_pages);
+		arena = NULL;
+		zswap_pages = 0;
+	}
+}
+
+/* Returns true if the page at KVA is all zeros. */
+static bool
+is_zero_page (const void *kva) {
+	const uint64_t *p = kva;
+	for (size_t i = 0; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != 0)
+			return false;
+	return true;
+}
+
+/* Compresses the page at KVA into the arena and records where in SLOT.
+ * Returns false, leaving SLOT untouched, if the page has to go to disk. */
+bool
+zswap_store (const void *kva, struct zswap_slot *slot) {
+	bool success = false;
+
+	lock_acquire (&zswap_lock);
+	store_cnt++;
+	if (arena == NULL)
+		goto done;
+
+	if (is_zero_page (kva)) {
+		slot->chunk = ZSWAP_ZERO;
+		slot->size = 0;
+		zero_cnt++;
+		stored_cnt++;
+		success = true;
+		goto done;
+	}
+
+	size_t size = lz_compress (kva, scratch, ZSWAP_MAX_SIZE);
+	if (size == 0)
+		goto done;
+
+	size_t chunk_cnt = (size + ZSWAP_CHUNK - 1) / ZSWAP_CHUNK;
+	size_t chunk = bitmap_scan_and_flip (chunk_map, 0, chunk_cnt, false);
+	if (chunk == BITMAP_ERROR)
+		goto done;
+
+	memcpy (arena + chunk * ZSWAP_CHUNK, scratch, size);
+	slot->chunk = chunk;
+	slot->size = size;
+	stored_cnt++;
+	stored_bytes += size;
+	success = true;
+
+done:
+	lock_release (&zswap_lock);
+	return success;
+}
+
+/* Releases the arena space of SLOT.  ZSWAP_LOCK must be held. */
+static void
+release_slot (struct zswap_slot *slot) {
+	if (slot->chunk != ZSWAP_ZERO) {
+		size_t chunk_cnt = (slot->size + ZSWAP_CHUNK - 1) / ZSWAP_CHUNK;
+		bitmap_set_multiple (chunk_map, slot->chunk, chunk_cnt, false);
+	}
+	slot->chunk = BITMAP_ERROR;
+}
+
+/* Decompresses the page in SLOT into KVA and frees SLOT.  Returns false if
+ * SLOT does not hold a page, i.e. the page has to come from disk. */
+bool
+zswap_load (struct zswap_slot *slot, void *kva) {
+	lock_acquire (&zswap_lock);
+	load_cnt++;
+	if (slot->chunk == BITMAP_ERROR) {
+		lock_release (&zswap_lock);
+		return false;
+	}
+
+	if (slot->chunk == ZSWAP_ZERO)
+		memset (kva, 0, PGSIZE);
+	else
+		lz_decompress (arena + slot->chunk * ZSWAP_CHUNK, kva);
+	hit_cnt++;
+	release_slot (slot);
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Frees SLOT, if it holds a page, without reading it. */
+void
+zswap_free (struct zswap_slot *slot) {
+	if (slot->chunk == BITMAP_ERROR)
+		return;
+
+	lock_acquire (&zswap_lock);
+	release_slot (slot);
+	lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap statistics. */
+void
+zswap_print_stats (void) {
+	long long ratio = stored_bytes > 0
+		? (stored_cnt - zero_cnt) * PGSIZE * 100 / stored_bytes : 0;
+	long long hit_pct = load_cnt > 0 ? hit_cnt * 100 / load_cnt : 0;
+
+	printf ("Zswap: %lld of %lld pages stored (%lld zero), "
+			"compression %lld.%02lld:1, %lld of %lld loads hit (%lld%%)\n",
+			stored_cnt, store_cnt, zero_cnt, ratio / 100, ratio % 100,
+			hit_cnt, load_cnt, hit_pct);
+}
+
+/* Returns the hash table slot for the 3 bytes at P. */
+static inline size_t
+lz_hash (const uint8_t *p) {
+	uint32_t v = p[0] | p[1] << 8 | p[2] << 16;
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the page at SRC into DST, which has room for CAP bytes.
+ * Returns the compressed size, or 0 if it would exceed CAP. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t cap) {
+	size_t in = 0, out = 0;
+
+	memset (lz_table, 0, sizeof lz_table);
+	while (in < PGSIZE) {
+		/* A group takes at most a control byte and eight matches. */
+		if (out + 1 + 8 * 2 > cap)
+			return 0;
+
+		size_t ctrl = out++;
+		dst[ctrl] = 0;
+		for (int bit = 0; bit < 8 && in < PGSIZE; bit++) {
+			size_t len = 0, cand = 0;
+
+			if (in + LZ_MIN_MATCH <= PGSIZE) {
+				size_t h = lz_hash (src + in);
+				cand = lz_table[h];
+				lz_table[h] = in;
+				if (cand < in && in - cand <= LZ_MAX_OFFSET) {
+					size_t max = PGSIZE - in < LZ_MAX_MATCH
+						? PGSIZE - in : LZ_MAX_MATCH;
+					while (len < max && src[cand + len] == src[in + len])
+						len++;
+				}
+			}
+
+			if (len >= LZ_MIN_MATCH) {
+				size_t ofs = in - cand;
+				dst[ctrl] |= 1 << bit;
+				dst[out++] = ofs & 0xff;
+				dst[out++] = (ofs >> 8) << 4 | (len - LZ_MIN_MATCH);
+				in += len;
+			} else
+				dst[out++] = src[in++];
+		}
+	}
+	return out;
+}
+
+/* Decompresses the output of lz_compress() at SRC into the page DST. */
+static void
+lz_decompress (const uint8_t *src, uint8_t *dst) {
+	size_t in = 0, out = 0;
+
+	while (out < PGSIZE) {
+		uint8_t ctrl = src[in++];
+		for (int bit = 0; bit < 8 && out < PGSIZE; bit++) {
+			if (ctrl & (1 << bit)) {
+				size_t ofs = src[in] | (src[in + 1] >> 4) << 8;
+				size_t len = (src[in + 1] & 0xf) + LZ_MIN_MATCH;
+				in += 2;
+				/* Byte by byte: the match may overlap its own output. */
+				for (; len > 0; len--, out++)
+					dst[out] = dst[out - ofs];
+			} else
+				dst[out++] = src[in++];
+		}
+	}
+}